@@ -15,6 +15,7 @@ struct Ast_Struct;
 struct Ast_Enum;
 struct Ast_Type_Alias;
 struct Ast_Case;
+struct Clang_Lazy_Import;
 
 enum Ast_Type {
     AST_UNINITIALIZED,
@@ -51,6 +52,7 @@ enum Ast_Type {
     AST_SWITCH,
     AST_CASE,
     AST_DEFINED,
+    AST_VECTOR_BUILTIN,
 };
 
 struct Ast {
@@ -74,6 +76,7 @@ struct Ast_Type_Info {
         // non-primitves
         POINTER,
         ARRAY,
+        VECTOR,
         ALIAS,
         FUNCTION,
         TYPE, // meta type assigned to typealias and struct
@@ -95,7 +98,7 @@ struct Ast_Type_Info {
     Ast_Type_Info  *alias_of      = nullptr;
     bool is_distinct = false;
 
-    array_count_type array_element_count = -1;
+    array_count_type array_element_count = -1; // for ARRAY and VECTOR
     bool is_dynamic = false; // for array
 
     Ast_Struct *struct_decl = nullptr;
@@ -170,6 +173,8 @@ struct Ast_Scope : Ast_Expression {
     Ast_Function   *owning_function = nullptr;  // @NoCopy this is set on the root scope by Copier::copy_function
     Ast_Expression *owning_statement = nullptr; // @NoCopy this is set by respective copying code for owner-nodes (Ast_For ...).
     Ast_Enum       *owning_enum = nullptr;
+
+    Clang_Lazy_Import *lazy_c_imports = nullptr; // @NoCopy C declarations that are converted to AST the first time their name is looked up in this scope.
 };
 
 // Used to specify a scope that was inserted due to the compiler resolving a static_if.
@@ -197,6 +202,10 @@ struct Ast_Type_Instantiation : Ast_Expression {
     Ast_Expression *array_size_expression = nullptr;
     bool array_is_dynamic = false;
 
+    // vec(element, width)
+    Ast_Type_Instantiation *vector_element_type = nullptr;
+    Ast_Expression *vector_width_expression = nullptr;
+
     Ast_Function *function_header = nullptr;
 
     Ast_Type_Info *type_value = nullptr; // @NoCopy
@@ -320,11 +329,20 @@ struct Ast_If : Ast_Expression {
     bool is_when = false;
 };
 
+// Optimizer hints from the #unroll, #vectorize and #assume_no_alias loop directives.
+struct Loop_Hints {
+    s64 unroll_count    = -1; // -1 if not specified, 0 for #unroll without a count, which unrolls the loop fully.
+    s64 vectorize_width = -1; // -1 if not specified, 0 for #vectorize without a width, which lets LLVM pick one.
+    bool assume_no_alias = false; // Memory accessed in different iterations never overlaps.
+};
+
 struct Ast_While : Ast_Expression {
     Ast_While() { type = AST_WHILE; }
 
     Ast_Expression *condition = nullptr;
     Ast_Scope body;
+
+    Loop_Hints hints;
 };
 
 struct Ast_Return : Ast_Expression {
@@ -367,6 +385,27 @@ struct Ast_Declaration : Ast_Scope_Entry {
     bool is_readonly_variable = false;
     bool is_struct_member = false;
     bool is_enum_member = false;
+
+    array_count_type llvm_value_index = -1; // @NoCopy Index into LLVM_Generator::decl_value_map, only meaningful while the enclosing function is emitted.
+};
+
+// The __builtin_* functions declared in the preload scope, which are lowered straight to LLVM intrinsics
+// instead of calls. See intrinsic_table in compiler_api.cpp.
+enum Intrinsic_Kind {
+    INTRINSIC_NONE,
+    INTRINSIC_DEBUGTRAP,
+    INTRINSIC_CTPOP,
+    INTRINSIC_CTLZ,
+    INTRINSIC_CTTZ,
+    INTRINSIC_BSWAP,
+    INTRINSIC_FMA,
+    INTRINSIC_SQRT,
+    INTRINSIC_RSQRT,
+    INTRINSIC_PREFETCH,
+    INTRINSIC_EXPECT,
+    INTRINSIC_ASSUME,
+    INTRINSIC_NONTEMPORAL_STORE,
+    INTRINSIC_READCYCLECOUNTER,
 };
 
 struct Ast_Function : Ast_Scope_Entry {
@@ -387,8 +426,12 @@ struct Ast_Function : Ast_Scope_Entry {
     bool is_template_function = false;
     bool is_exported = false;
     bool is_operator_function = false;
-    bool is_intrinsic = false;
+    bool is_marked_inline = false;   // @inline, always inlined, even at -O0.
+    bool is_marked_noinline = false; // @noinline
+    bool is_marked_cold = false;     // @cold, rarely called, optimized for size and placed away from hot code.
+    bool is_marked_hot = false;      // @hot
     Token::Type operator_type;
+    Intrinsic_Kind intrinsic_kind = INTRINSIC_NONE;
 
     String linkage_name;       // @NoCopy
     bool body_checked = false; // @NoCopy
@@ -425,6 +468,24 @@ struct Ast_Defined : Ast_Expression {
     Ast_Identifier *identifier = nullptr;
 };
 
+// Generated by Sema for swizzles (v.xy) and the __builtin_shuffle/__builtin_reduce_* calls.
+struct Ast_Vector_Builtin : Ast_Expression {
+    Ast_Vector_Builtin() { type = AST_VECTOR_BUILTIN; }
+
+    enum Kind {
+        SHUFFLE,
+        REDUCE_ADD,
+        REDUCE_MUL,
+        REDUCE_MIN,
+        REDUCE_MAX,
+    };
+
+    Kind builtin_kind = SHUFFLE;
+
+    Array<Ast_Expression *> arguments; // one or two vectors for SHUFFLE, one vector for the reductions
+    Array<s64> shuffle_mask;           // indices into the concatenation of the SHUFFLE arguments
+};
+
 struct Ast_For : Ast_Expression {
     Ast_For() { type = AST_FOR; }
 
@@ -442,6 +503,8 @@ struct Ast_For : Ast_Expression {
 
     Ast_Scope iterator_declaration_scope; // @NoCopy filled by Sema
     Ast_Scope body;
+
+    Loop_Hints hints;
 };
 
 struct Ast_Control_Flow : Ast_Expression {
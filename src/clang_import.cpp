@@ -1,6 +1,7 @@
 #include "clang_import.h"
 #include "compiler.h"
 #include "llvm.h"
+#include "sema.h"
 
 #include <new> // for placement new
 #include <clang-c/Index.h>
@@ -10,6 +11,9 @@
 #endif
 
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
 
 #ifdef WIN32
 #pragma warning(pop)
@@ -25,36 +29,131 @@ void *init_ast(Ast *_new, String filename) {
 }
 
 
-// Map Clang USR to Jiyu AST nodes.
+// Imported C declarations are first translated from libclang cursors into flat records, which are
+// cheap to build, can be saved to the cache directory, and are converted to jiyu AST lazily.
+// Records refer to each other by index so they can be written to and read from disk as-is.
+
+enum C_Type_Kind : u8 {
+    C_TYPE_VOID,
+    C_TYPE_BOOL,
+    C_TYPE_SIGNED,
+    C_TYPE_UNSIGNED,
+    C_TYPE_FLOAT,
+    C_TYPE_POINTER,
+    C_TYPE_ARRAY,
+    C_TYPE_FUNCTION,
+    C_TYPE_DECLARATION, // struct, union, enum or typedef
+};
+
+struct C_Type {
+    C_Type_Kind kind;
+    bool is_varargs = false; // FUNCTION
+
+    s64 size = 0;            // Byte size of SIGNED, UNSIGNED and FLOAT, element count of ARRAY.
+    s32 element = -1;        // Pointee of POINTER, element of ARRAY, return type of FUNCTION.
+    s32 declaration = -1;    // DECLARATION
+
+    s32 first_argument = 0;  // FUNCTION, argument types are in Clang_Lazy_Import::indices.
+    s32 argument_count = 0;
+
+    Ast_Type_Info *type_info = nullptr; // Not serialized.
+};
+
+enum C_Decl_Kind : u8 {
+    C_DECL_FUNCTION,
+    C_DECL_PARAMETER,
+    C_DECL_TYPEDEF,
+    C_DECL_ENUM,
+    C_DECL_ENUM_CONSTANT,
+    C_DECL_STRUCT,
+    C_DECL_FIELD,
+};
+
+struct C_Decl {
+    C_Decl_Kind kind;
+
+    bool is_varargs   = false; // FUNCTION
+    bool is_union     = false; // STRUCT
+    bool is_anonymous = false; // STRUCT
+    bool is_filled    = false; // STRUCT, false if we only saw a forward declaration.
+    bool is_bitfield  = false; // FIELD
+
+    String name;
+    String filename;     // The C file this was declared in.
+    String linkage_name; // FUNCTION
+    String location;     // FIELD, for error reporting.
+
+    s32 type = -1;       // Return type of FUNCTION, underlying type of TYPEDEF and ENUM, type of everything else.
+    s64 value = 0;       // ENUM_CONSTANT
+    s64 size = 0;        // STRUCT
+    s64 alignment = 0;   // STRUCT
+
+    s32 first_member = 0; // Parameters of FUNCTION, constants of ENUM, fields and nested declarations of STRUCT.
+    s32 member_count = 0; // Member indices are in Clang_Lazy_Import::indices.
+
+    bool names_registered = false;   // Not serialized.
+    Ast_Scope_Entry *ast  = nullptr; // Not serialized.
+};
+
+// A name that can be looked up in the target scope, and the declaration it materializes.
+struct C_Name {
+    String name;
+    u32    hash; // Atom_Table::hash_key(name), so we do not have to make atoms for names that are never looked up.
+    s32    decl;
+};
+
+const u32 CLANG_NAME_BUCKET_COUNT = 256; // Must be a power of two.
+
+struct Clang_Lazy_Import {
+    Compiler  *compiler = nullptr;
+    Ast_Scope *target_scope = nullptr;
+
+    Array<C_Type> types;
+    Array<C_Decl> decls;
+    Array<s32>    indices;
+    Array<C_Name> names;
+
+    // Names that have not been materialized yet, bucketed by hash.
+    Array<C_Name> name_buckets[CLANG_NAME_BUCKET_COUNT];
+
+    // Structs added to target_scope that sema has to typecheck once the current lookup is done.
+    Array<Ast_Struct *> pending_structs;
+
+    Clang_Lazy_Import *next = nullptr; // The next import into the same target_scope.
+};
+
+// Map Clang USR to declaration records.
 struct USR_Pair {
     String usr;
-    Ast   *ast;
+    s32    decl;
 };
 
-Ast *find_ast(Array<USR_Pair> *map, String usr) {
+static
+s32 find_decl(Array<USR_Pair> *map, String usr) {
     for (auto entry: (*map)) {
         if (entry.usr == usr) {
-            return entry.ast;
+            return entry.decl;
         }
     }
 
-    return nullptr;
+    return -1;
 }
 
-void add_usr_mapping(Array<USR_Pair> *map, String usr, Ast *jiyu_ast) {
-    assert(find_ast(map, usr) == nullptr);
+static
+void add_usr_mapping(Array<USR_Pair> *map, String usr, s32 decl) {
+    assert(find_decl(map, usr) < 0);
 
     USR_Pair pair;
-    pair.usr = usr;
-    pair.ast = jiyu_ast;
+    pair.usr  = usr;
+    pair.decl = decl;
 
     map->add(pair);
 }
 
-struct Visitor_Data {
+struct Record_Builder {
     Compiler *compiler;
-    Ast_Scope *target_scope;
-    Array<USR_Pair>    *usr_map = nullptr;
+    Clang_Lazy_Import *import;
+    Array<USR_Pair> usr_map;
 };
 
 static
@@ -65,17 +164,65 @@ String copy_and_dispose(Compiler *compiler, CXString input) {
 }
 
 static
-Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
-    Compiler *compiler = data->compiler;
+s32 add_type(Clang_Lazy_Import *import, C_Type type) {
+    import->types.add(type);
+    return import->types.count-1;
+}
+
+static
+s32 add_decl(Clang_Lazy_Import *import, C_Decl decl) {
+    import->decls.add(decl);
+    return import->decls.count-1;
+}
+
+static
+s32 add_indices(Clang_Lazy_Import *import, Array<s32> *list) {
+    s32 first = import->indices.count;
+    for (auto index : *list) import->indices.add(index);
+    return first;
+}
+
+static
+s32 build_declaration(Record_Builder *builder, CXCursor cursor);
+
+static
+s32 make_sized_type(Clang_Lazy_Import *import, C_Type_Kind kind, s64 size) {
+    C_Type type;
+    type.kind = kind;
+    type.size = size;
+    return add_type(import, type);
+}
+
+// Returns the declaration record for the declaration of a struct, enum or typedef type, building it if we have not seen it yet.
+static
+s32 make_declaration_type(Record_Builder *builder, CXCursor type_decl) {
+    String usr = copy_and_dispose(builder->compiler, clang_getCursorUSR(type_decl));
+    s32 decl = find_decl(&builder->usr_map, usr);
+    if (decl < 0) {
+        decl = build_declaration(builder, type_decl);
+    }
+
+    assert(decl >= 0);
+
+    C_Type type;
+    type.kind = C_TYPE_DECLARATION;
+    type.declaration = decl;
+    return add_type(builder->import, type);
+}
+
+static
+s32 translate_type(Record_Builder *builder, CXType type) {
+    Compiler *compiler = builder->compiler;
+    auto import = builder->import;
     CXTypeKind kind = type.kind;
 
     switch (kind) {
         /* Builtin types */
-        case CXType_Void:   return compiler->type_void;
-        case CXType_Bool:   return compiler->type_bool;
+        case CXType_Void:   return make_sized_type(import, C_TYPE_VOID, 0);
+        case CXType_Bool:   return make_sized_type(import, C_TYPE_BOOL, 1);
 
-        case CXType_Char16: return compiler->type_uint16;
-        case CXType_Char32: return compiler->type_uint32;
+        case CXType_Char16: return make_sized_type(import, C_TYPE_UNSIGNED, 2);
+        case CXType_Char32: return make_sized_type(import, C_TYPE_UNSIGNED, 4);
 
         case CXType_Char_U:
         case CXType_UChar:
@@ -85,14 +232,9 @@ Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
         case CXType_ULongLong:
         case CXType_UInt128: {
             auto size = clang_Type_getSizeOf(type);
+            assert(size == 1 || size == 2 || size == 4 || size == 8); // @Incomplete 128bit
 
-            if      (size == 1) return compiler->type_uint8;
-            else if (size == 2) return compiler->type_uint16;
-            else if (size == 4) return compiler->type_uint32;
-            else if (size == 8) return compiler->type_uint64;
-            else assert(false); // @Incomplete 128bit
-
-            return nullptr;
+            return make_sized_type(import, C_TYPE_UNSIGNED, size);
         }
 
 
@@ -105,14 +247,9 @@ Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
         case CXType_LongLong:
         case CXType_Int128: {
             auto size = clang_Type_getSizeOf(type);
+            assert(size == 1 || size == 2 || size == 4 || size == 8); // @Incomplete 128bit
 
-            if      (size == 1) return compiler->type_int8;
-            else if (size == 2) return compiler->type_int16;
-            else if (size == 4) return compiler->type_int32;
-            else if (size == 8) return compiler->type_int64;
-            else assert(false); // @Incomplete 128bit
-
-            return nullptr;
+            return make_sized_type(import, C_TYPE_SIGNED, size);
         }
 
         case CXType_Float16:
@@ -122,13 +259,9 @@ Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
         case CXType_LongDouble:
         case CXType_Float128: {
             auto size = clang_Type_getSizeOf(type);
+            assert(size == 4 || size == 8 || size == 16); // @Incomplete half/float16 ?
 
-            if      (size == 4)  return compiler->type_float32;
-            else if (size == 8)  return compiler->type_float64;
-            else if (size == 16) return compiler->type_float128;
-            else assert(false); // @Incomplete half/float16 ?
-
-            return nullptr;
+            return make_sized_type(import, C_TYPE_FLOAT, size);
         }
 
 
@@ -153,9 +286,15 @@ Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
             CXType pointee = clang_getPointeeType(type);
             if (pointee.kind == CXType_FunctionProto) {
                 // the plain function-pointer-type in Jiyu is 1 level of indirection away from C (which defaults to a pointer-to-function).
-                return get_jiyu_type(data, pointee);
+                return translate_type(builder, pointee);
             }
-            return compiler->make_pointer_type(get_jiyu_type(data, pointee));
+
+            s32 element = translate_type(builder, pointee);
+
+            C_Type result;
+            result.kind = C_TYPE_POINTER;
+            result.element = element;
+            return add_type(import, result);
         }
 
         // CXType_BlockPointer = 102,
@@ -164,71 +303,50 @@ Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
         case CXType_Record: {
             CXCursor struct_decl = clang_getTypeDeclaration(type);
             struct_decl = clang_getCanonicalCursor(struct_decl);
-            String usr = copy_and_dispose(compiler, clang_getCursorUSR(struct_decl));
-            Ast *ast = find_ast(data->usr_map, usr);
 
-            assert(ast && ast->type == AST_STRUCT);
-            auto result = get_type_declaration_resolved_type(ast);
-            assert(result);
-            return result;
-        }
+            // Prefer the definition so the struct record is filled when we first build it.
+            CXCursor definition = clang_getCursorDefinition(struct_decl);
+            if (!clang_Cursor_isNull(definition)) struct_decl = definition;
 
-        // @Incomplete enums arent supported in jiyu yet
-        case CXType_Enum: {
-            CXCursor type_decl = clang_getTypeDeclaration(type);
-            String usr = copy_and_dispose(compiler, clang_getCursorUSR(type_decl));
-            Ast *ast = find_ast(data->usr_map, usr);
-
-            assert(ast && ast->type == AST_TYPE_ALIAS); // @Incomplete change to AST_ENUM when that exists.
-            auto result = get_type_declaration_resolved_type(ast);
-            assert(result);
-            return result;
+            return make_declaration_type(builder, struct_decl);
         }
 
-
+        // @Incomplete enums arent supported in jiyu yet
+        case CXType_Enum:
         case CXType_Typedef: {
-            CXCursor type_decl = clang_getTypeDeclaration(type);
-            String usr = copy_and_dispose(compiler, clang_getCursorUSR(type_decl));
-            Ast *ast = find_ast(data->usr_map, usr);
-
-            assert(ast && ast->type == AST_TYPE_ALIAS);
-            auto result = get_type_declaration_resolved_type(ast);
-            assert(result);
-            return result;
+            return make_declaration_type(builder, clang_getTypeDeclaration(type));
         }
 
         // CXType_ObjCInterface = 108,
         // CXType_ObjCObjectPointer = 109,
         // CXType_FunctionNoProto = 110,
         case CXType_FunctionProto: {
-            // @Cutnpaste from Compiler::make_function_type
-            Ast_Type_Info *info = IMPORT_NEW2(Ast_Type_Info);
-            info->type      = Ast_Type_Info::FUNCTION;
-            info->size      = compiler->type_ptr_void->size;
-            info->stride    = compiler->type_ptr_void->stride;
-            info->alignment = compiler->type_ptr_void->stride;
-
-            info->is_c_function = true;
-            info->is_c_varargs  = (clang_isFunctionTypeVariadic(type) != 0);
+            Array<s32> arguments;
 
             auto arg_count = clang_getNumArgTypes(type);
             for (int i = 0; i < arg_count; ++i) {
-                auto arg_info = get_jiyu_type(data, clang_getArgType(type, i));
-
-                info->arguments.add(arg_info);
+                arguments.add(translate_type(builder, clang_getArgType(type, i)));
             }
 
+            s32 return_type = translate_type(builder, clang_getResultType(type));
 
-            info->return_type = get_jiyu_type(data, clang_getResultType(type));
-
-            compiler->add_to_type_table(info);
-            return info;
+            C_Type result;
+            result.kind = C_TYPE_FUNCTION;
+            result.is_varargs = (clang_isFunctionTypeVariadic(type) != 0);
+            result.element = return_type;
+            result.first_argument = add_indices(import, &arguments);
+            result.argument_count = arguments.count;
+            return add_type(import, result);
         }
         case CXType_ConstantArray: {
             auto element_count = clang_getNumElements(type);
-            auto element_type = get_jiyu_type(data, clang_getArrayElementType(type));
+            s32 element = translate_type(builder, clang_getArrayElementType(type));
 
-            return compiler->make_array_type(element_type, element_count, /*is_dynamic=*/false);
+            C_Type result;
+            result.kind = C_TYPE_ARRAY;
+            result.size = element_count;
+            result.element = element;
+            return add_type(import, result);
         }
         // CXType_Vector = 113,
 
@@ -236,8 +354,12 @@ Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
         case CXType_IncompleteArray: {
             // <type> name[]; just turn these into pointers since we dont have compatible types
             // and a pointer allows the user to just do: <jiyu_array>.data.
-            auto element_type = get_jiyu_type(data, clang_getArrayElementType(type));
-            return compiler->make_pointer_type(element_type);
+            s32 element = translate_type(builder, clang_getArrayElementType(type));
+
+            C_Type result;
+            result.kind = C_TYPE_POINTER;
+            result.element = element;
+            return add_type(import, result);
         }
         // CXType_VariableArray = 115,
         // CXType_DependentSizedArray = 116,
@@ -246,7 +368,7 @@ Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
         // CXType_Auto = 118,
 
         case CXType_Elaborated: { // Why Clang, why.
-            return get_jiyu_type(data, clang_Type_getNamedType(type));
+            return translate_type(builder, clang_Type_getNamedType(type));
         }
 
         // @Temporary just silencing a GCC warning. Remove when we have individual cases for all CXTypeKind's.
@@ -256,315 +378,1061 @@ Ast_Type_Info *get_jiyu_type(Visitor_Data *data, CXType type) {
 
     CXString kind_string = clang_getTypeKindSpelling(type.kind);
     if (compiler->build_options.verbose_diagnostics) {
-        compiler->report_error((Ast *)nullptr, "Unhandled CXTypeKind in get_jiyu_type: %s. This is a message for maintainers.\n", clang_getCString(kind_string));
+        compiler->report_error((Ast *)nullptr, "Unhandled CXTypeKind in translate_type: %s. This is a message for maintainers.\n", clang_getCString(kind_string));
     }
     clang_disposeString(kind_string);
 
     assert(false);
-    return nullptr;
+    return -1;
 }
 
+struct Member_Visitor_Data {
+    Record_Builder *builder;
+    Array<s32>     *members;
+};
+
 static
-CXChildVisitResult cursor_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
-    Visitor_Data *visitor_data = reinterpret_cast<Visitor_Data *>(client_data);
-    Compiler  *compiler       = visitor_data->compiler;
-    Ast_Scope *current_scope = visitor_data->target_scope;
-    Array<USR_Pair>    *usr_map = visitor_data->usr_map;
+CXChildVisitResult member_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
+    auto data = reinterpret_cast<Member_Visitor_Data *>(client_data);
 
-    auto kind_string = clang_getCursorKindSpelling(cursor.kind);
-    // printf("USR   %s\n", clang_getCString(clang_getCursorUSR(cursor)));
-    clang_disposeString(kind_string);
+    if (cursor.kind == CXCursor_UnexposedAttr) {
+        // @Hack this is usually just extern "C", but clang_Cursor_getMangling handles the linkage for us.
+        return CXChildVisit_Recurse;
+    }
+
+    s32 decl = build_declaration(data->builder, cursor);
+    if (decl >= 0) data->members->add(decl);
+
+    return CXChildVisit_Continue;
+}
 
-    auto usr_string = clang_getCursorUSR(cursor);
-    String my_usr_string = compiler->copy_string(to_string(clang_getCString(usr_string)));
-    clang_disposeString(usr_string);
+// Returns the record index, or -1 if this is not a kind of declaration we import.
+static
+s32 build_declaration(Record_Builder *builder, CXCursor cursor) {
+    Compiler *compiler = builder->compiler;
+    auto import = builder->import;
+
+    String my_usr_string = copy_and_dispose(compiler, clang_getCursorUSR(cursor));
+    String name          = copy_and_dispose(compiler, clang_getCursorSpelling(cursor));
 
-    auto location = clang_getCursorLocation(cursor);
     CXFile file;
     unsigned line;
     unsigned column;
     unsigned offset;
-    clang_getFileLocation(location, &file, &line, &column, &offset);
+    clang_getFileLocation(clang_getCursorLocation(cursor), &file, &line, &column, &offset);
 
-    auto filename = copy_and_dispose(compiler, clang_getFileName(file));
+    String filename = copy_and_dispose(compiler, clang_getFileName(file));
 
     switch (cursor.kind) {
-        case CXCursor_UnexposedAttr: {
-            // @Hack this is usually just extern "C", but clang_Cursor_getMangling handles the linkage for us.
-            return CXChildVisit_Recurse;
-        }
         case CXCursor_FunctionDecl: {
             cursor = clang_getCanonicalCursor(cursor);
-            if (find_ast(usr_map, my_usr_string)) {
-                break; // Skip, we've already filled this function
-            }
 
-            Ast_Function *function = IMPORT_NEW(Ast_Function);
-            add_usr_mapping(usr_map, my_usr_string, function);
+            s32 existing = find_decl(&builder->usr_map, my_usr_string);
+            if (existing >= 0) return existing; // Skip, we've already filled this function
 
-            function->is_c_function = true;
-            function->is_c_varargs  = (clang_Cursor_isVariadic(cursor) != 0);
+            C_Decl function;
+            function.kind = C_DECL_FUNCTION;
+            function.filename = filename;
+            function.name = name;
+            function.is_varargs = (clang_Cursor_isVariadic(cursor) != 0);
 
-            CXString cxstring = clang_getCursorSpelling(cursor);
-            defer { clang_disposeString(cxstring); };
+            s32 index = add_decl(import, function);
+            add_usr_mapping(&builder->usr_map, my_usr_string, index);
 
-            String name = to_string(clang_getCString(cxstring));
-
-            Atom *name_atom = compiler->make_atom(name);
-            function->identifier = make_identifier(compiler, name_atom);
-            function->identifier->enclosing_scope = current_scope;
+            Array<s32> parameters;
 
             int num_args = clang_Cursor_getNumArguments(cursor);
             for (int i = 0; i < num_args; ++i) {
                 CXCursor param = clang_Cursor_getArgument(cursor, i);
-                CXType param_type = clang_getCursorType(param);
 
-                CXString cxstring = clang_getCursorSpelling(param);
-                defer { clang_disposeString(cxstring); };
+                C_Decl param_decl;
+                param_decl.kind = C_DECL_PARAMETER;
+                param_decl.filename = filename;
+                param_decl.name = copy_and_dispose(compiler, clang_getCursorSpelling(param));
+                param_decl.type = translate_type(builder, clang_getCursorType(param));
 
-                Ast_Type_Info *type_info = get_jiyu_type(visitor_data, param_type);
+                parameters.add(add_decl(import, param_decl));
+            }
 
-                String name = to_string(clang_getCString(cxstring));
-                Atom *name_atom = compiler->make_atom(name);
-                Ast_Declaration *param_decl = IMPORT_NEW(Ast_Declaration);
-                param_decl->identifier = make_identifier(compiler, name_atom);
-                param_decl->type_info = type_info;
+            String linkage_name = copy_and_dispose(compiler, clang_Cursor_getMangling(cursor));
+            // On Darwin targets (MacOSX, iOS, etc..), getMangling returns the full symbol name
+            // of the symbol as it appears in the binary (malloc would be mangled to _malloc), but
+            // LLVM expects the symbol name without the beginning underscore that MacOSX tools insert
+            // at link time, so skip it.
+            if (compiler->llvm_gen->TargetMachine->getTargetTriple().isOSDarwin()) {
+                advance(&linkage_name, 1);
+            }
 
-                function->arguments.add(param_decl);
+            s32 return_type = translate_type(builder, clang_getCursorResultType(cursor));
+
+            C_Decl *result = &import->decls[index];
+            result->linkage_name = linkage_name;
+            result->type = return_type;
+            result->first_member = add_indices(import, &parameters);
+            result->member_count = parameters.count;
+            return index;
+        }
+
+        case CXCursor_TypedefDecl: {
+            s32 existing = find_decl(&builder->usr_map, my_usr_string);
+            if (existing >= 0) return existing;
+
+            C_Decl alias;
+            alias.kind = C_DECL_TYPEDEF;
+            alias.filename = filename;
+            alias.name = name;
+
+            s32 index = add_decl(import, alias);
+            add_usr_mapping(&builder->usr_map, my_usr_string, index);
+
+            s32 underlying_type = translate_type(builder, clang_getTypedefDeclUnderlyingType(cursor));
+            import->decls[index].type = underlying_type;
+            return index;
+        }
+
+        case CXCursor_EnumDecl: {
+            // @TODO since we do not have enums yet, just import the type of the enum as
+            // a typealias to the underlying C type and import enumerates as lets.
+            s32 existing = find_decl(&builder->usr_map, my_usr_string);
+            if (existing >= 0) return existing;
+
+            C_Decl _enum;
+            _enum.kind = C_DECL_ENUM;
+            _enum.filename = filename;
+            _enum.name = name;
+
+            s32 index = add_decl(import, _enum);
+            add_usr_mapping(&builder->usr_map, my_usr_string, index);
+
+            s32 underlying_type = translate_type(builder, clang_getEnumDeclIntegerType(cursor));
+
+            Array<s32> constants;
+            Member_Visitor_Data data;
+            data.builder = builder;
+            data.members = &constants;
+            clang_visitChildren(cursor, member_visitor, &data);
+
+            C_Decl *result = &import->decls[index];
+            result->type = underlying_type;
+            result->first_member = add_indices(import, &constants);
+            result->member_count = constants.count;
+            return index;
+        }
+
+        case CXCursor_EnumConstantDecl: {
+            C_Decl constant;
+            constant.kind  = C_DECL_ENUM_CONSTANT;
+            constant.filename = filename;
+            constant.name  = name;
+            constant.value = clang_getEnumConstantDeclValue(cursor);
+            constant.type  = translate_type(builder, clang_getCursorType(cursor));
+            return add_decl(import, constant);
+        }
+
+        case CXCursor_UnionDecl:
+        case CXCursor_StructDecl: {
+            s32 existing = find_decl(&builder->usr_map, my_usr_string);
+            if (existing >= 0 && (!clang_isCursorDefinition(cursor) || import->decls[existing].is_filled)) {
+                return existing; // Skip, we've already filled the type.
             }
 
-            {
-                CXString cxstring = clang_Cursor_getMangling(cursor);
-                defer { clang_disposeString(cxstring); };
-
-                String name = to_string(clang_getCString(cxstring));
-                // On Darwin targets (MacOSX, iOS, etc..), getMangling returns the full symbol name
-                // of the symbol as it appears in the binary (malloc would be mangled to _malloc), but
-                // LLVM expects the symbol name without the beginning underscore that MacOSX tools insert
-                // at link time, so skip it.
-                if (compiler->llvm_gen->TargetMachine->getTargetTriple().isOSDarwin()) {
-                    advance(&name, 1);
+            s32 index = existing;
+            if (index < 0) {
+                C_Decl _struct;
+                _struct.kind = C_DECL_STRUCT;
+                _struct.filename = filename;
+                _struct.is_union = (cursor.kind == CXCursor_UnionDecl);
+                _struct.is_anonymous = (clang_Cursor_isAnonymousRecordDecl(cursor) != 0);
+
+                index = add_decl(import, _struct);
+
+                // Do not add anonymous records to USR mappings,
+                // because two anonymous records in the same scope
+                // have the same USR mapping (and because we will not be referenced by variable declarations).
+                if (!_struct.is_anonymous) add_usr_mapping(&builder->usr_map, my_usr_string, index);
+
+                if (_struct.is_anonymous) assert(clang_isCursorDefinition(cursor));
+            }
+
+            if (clang_isCursorDefinition(cursor) || clang_Cursor_isNull(clang_getCursorDefinition(cursor))) {
+                auto cursor_type = clang_getCursorType(cursor);
+
+                {
+                    C_Decl *_struct = &import->decls[index];
+                    _struct->is_filled = true;
+                    _struct->name = name;
+                    _struct->size = clang_Type_getSizeOf(cursor_type);
+                    _struct->alignment = clang_Type_getAlignOf(cursor_type);
                 }
-                function->linkage_name = compiler->copy_string(name);
+
+                Array<s32> members;
+                Member_Visitor_Data data;
+                data.builder = builder;
+                data.members = &members;
+                clang_visitChildren(cursor, member_visitor, &data);
+
+                C_Decl *_struct = &import->decls[index];
+                _struct->first_member = add_indices(import, &members);
+                _struct->member_count = members.count;
+            }
+
+            return index;
+        }
+
+        case CXCursor_FieldDecl: {
+            C_Decl field;
+            field.kind = C_DECL_FIELD;
+            field.filename = filename;
+            field.name = name;
+            field.type = translate_type(builder, clang_getCursorType(cursor));
+
+            if (clang_Cursor_isBitField(cursor)) {
+                // Reported if the struct is ever used.
+                field.is_bitfield = true;
+                field.location = mprintf("%.*s:%u:%u", PRINT_ARG(filename), line, column); // @Leak
+            }
+
+            return add_decl(import, field);
+        }
+
+        default: {
+            CXString kind_string = clang_getCursorKindSpelling(cursor.kind);
+            if (compiler->build_options.verbose_diagnostics) printf("Unahndled CXCursor in build_declaration. kind: %s, name: %.*s. This is a message for maintainers.\n", clang_getCString(kind_string), PRINT_ARG(name));
+            clang_disposeString(kind_string);
+            return -1;
+        }
+    }
+}
+
+static
+void add_name(Clang_Lazy_Import *import, String name, s32 decl) {
+    if (name == String()) return;
+
+    C_Name entry;
+    entry.name = name;
+    entry.hash = import->compiler->atom_table->hash_key(name);
+    entry.decl = decl;
+    import->names.add(entry);
+}
+
+static
+void register_names(Clang_Lazy_Import *import, s32 index) {
+    C_Decl *decl = &import->decls[index];
+    if (decl->names_registered) return;
+    decl->names_registered = true;
+
+    add_name(import, decl->name, index);
+
+    if (decl->kind == C_DECL_ENUM) {
+        // Enumerators materialize their entire enum.
+        for (s32 i = 0; i < decl->member_count; ++i) {
+            auto constant = &import->decls[import->indices[decl->first_member + i]];
+            add_name(import, constant->name, index);
+        }
+    }
+}
+
+static
+CXChildVisitResult top_level_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
+    auto builder = reinterpret_cast<Record_Builder *>(client_data);
+
+    switch (cursor.kind) {
+        case CXCursor_UnexposedAttr:
+            return CXChildVisit_Recurse;
+
+        case CXCursor_FunctionDecl:
+        case CXCursor_TypedefDecl:
+        case CXCursor_EnumDecl:
+        case CXCursor_UnionDecl:
+        case CXCursor_StructDecl: {
+            s32 decl = build_declaration(builder, cursor);
+            if (decl >= 0) register_names(builder->import, decl);
+            return CXChildVisit_Continue;
+        }
+
+        default:
+            return CXChildVisit_Continue;
+    }
+}
+
+static
+void build_records(Compiler *compiler, Clang_Lazy_Import *import, CXTranslationUnit translation_unit) {
+    MICROPROFILE_SCOPEI("clang", "build_records", -1);
+
+    Record_Builder builder;
+    builder.compiler = compiler;
+    builder.import   = import;
+
+    // @Cleanup these built-in C declarations should exist in a specific shared scope
+    // for all C imports, otherwise we are widening the surface area of duplication in
+    // the same scope by default.
+
+    // Add __va_list_tag; I haven't experienced needing this on Windows, I am presuming it is a legacy thing
+    // that exists in older Linux/Mac/BSD code. -josh 3 January 2020
+    if (!compiler->llvm_gen->TargetMachine->getTargetTriple().isOSWindows()) {
+        C_Decl _struct;
+        _struct.kind = C_DECL_STRUCT;
+        add_usr_mapping(&builder.usr_map, to_string("c:@S@__va_list_tag"), add_decl(import, _struct));
+    }
+
+    // Add __builtin_va_list definition (officially *void under GCC/Clang, idk if this is true under Windows for Clang @TODO)
+    {
+        C_Type pointer;
+        pointer.kind = C_TYPE_POINTER;
+        pointer.element = make_sized_type(import, C_TYPE_VOID, 0);
+
+        C_Decl alias;
+        alias.kind = C_DECL_TYPEDEF;
+        alias.type = add_type(import, pointer);
+        add_usr_mapping(&builder.usr_map, to_string("c:@T@__builtin_va_list"), add_decl(import, alias));
+    }
+
+    clang_visitChildren(clang_getTranslationUnitCursor(translation_unit), top_level_visitor, &builder);
+}
+
+// Declarations materialized into the target scope are only added to its lookup, since
+// materialization happens while sema may be iterating the scope's statements. They get
+// typechecked when sema finds them.
+static
+void add_to_scope(Clang_Lazy_Import *import, Ast_Scope *scope, Ast_Scope_Entry *decl) {
+    if (scope != import->target_scope) scope->statements.add(decl);
+    scope->declarations.add(decl);
+}
+
+static
+Ast_Scope_Entry *materialize_declaration(Clang_Lazy_Import *import, s32 index, Ast_Scope *scope);
+
+static
+Ast_Type_Info *get_jiyu_type(Clang_Lazy_Import *import, s32 index) {
+    Compiler *compiler = import->compiler;
+
+    if (import->types[index].type_info) return import->types[index].type_info;
+
+    C_Type type = import->types[index];
+    Ast_Type_Info *result = nullptr;
+
+    switch (type.kind) {
+        case C_TYPE_VOID: result = compiler->type_void; break;
+        case C_TYPE_BOOL: result = compiler->type_bool; break;
+
+        case C_TYPE_SIGNED: {
+            if      (type.size == 1) result = compiler->type_int8;
+            else if (type.size == 2) result = compiler->type_int16;
+            else if (type.size == 4) result = compiler->type_int32;
+            else if (type.size == 8) result = compiler->type_int64;
+            break;
+        }
+
+        case C_TYPE_UNSIGNED: {
+            if      (type.size == 1) result = compiler->type_uint8;
+            else if (type.size == 2) result = compiler->type_uint16;
+            else if (type.size == 4) result = compiler->type_uint32;
+            else if (type.size == 8) result = compiler->type_uint64;
+            break;
+        }
+
+        case C_TYPE_FLOAT: {
+            if      (type.size == 4)  result = compiler->type_float32;
+            else if (type.size == 8)  result = compiler->type_float64;
+            else if (type.size == 16) result = compiler->type_float128;
+            break;
+        }
+
+        case C_TYPE_POINTER: {
+            result = compiler->make_pointer_type(get_jiyu_type(import, type.element));
+            break;
+        }
+
+        case C_TYPE_ARRAY: {
+            result = compiler->make_array_type(get_jiyu_type(import, type.element), type.size, /*is_dynamic=*/false);
+            break;
+        }
+
+        case C_TYPE_FUNCTION: {
+            // @Cutnpaste from Compiler::make_function_type
+            Ast_Type_Info *info = IMPORT_NEW2(Ast_Type_Info);
+            info->type      = Ast_Type_Info::FUNCTION;
+            info->size      = compiler->type_ptr_void->size;
+            info->stride    = compiler->type_ptr_void->stride;
+            info->alignment = compiler->type_ptr_void->stride;
+
+            info->is_c_function = true;
+            info->is_c_varargs  = type.is_varargs;
+
+            for (s32 i = 0; i < type.argument_count; ++i) {
+                info->arguments.add(get_jiyu_type(import, import->indices[type.first_argument + i]));
+            }
+
+            info->return_type = get_jiyu_type(import, type.element);
+
+            compiler->add_to_type_table(info);
+            result = info;
+            break;
+        }
+
+        case C_TYPE_DECLARATION: {
+            auto ast = materialize_declaration(import, type.declaration, import->target_scope);
+            result = get_type_declaration_resolved_type(ast);
+            break;
+        }
+    }
+
+    assert(result);
+    import->types[index].type_info = result;
+    return result;
+}
+
+static
+void set_identifier(Compiler *compiler, Ast_Scope_Entry *ast, String name, Ast_Scope *scope) {
+    if (name == String()) return;
+
+    ast->identifier = make_identifier(compiler, compiler->make_atom(name));
+    ast->identifier->enclosing_scope = scope;
+}
+
+static
+Ast_Scope_Entry *materialize_declaration(Clang_Lazy_Import *import, s32 index, Ast_Scope *scope) {
+    Compiler *compiler = import->compiler;
+
+    if (import->decls[index].ast) return import->decls[index].ast;
+
+    // Records are not added to while materializing, so this pointer stays valid.
+    C_Decl *decl = &import->decls[index];
+    String filename = decl->filename; // For IMPORT_NEW
+
+    switch (decl->kind) {
+        case C_DECL_FUNCTION: {
+            Ast_Function *function = IMPORT_NEW(Ast_Function);
+            decl->ast = function;
+
+            function->is_c_function = true;
+            function->is_c_varargs  = decl->is_varargs;
+            set_identifier(compiler, function, decl->name, scope);
+
+            for (s32 i = 0; i < decl->member_count; ++i) {
+                auto param = &import->decls[import->indices[decl->first_member + i]];
+                assert(param->kind == C_DECL_PARAMETER);
+
+                Ast_Declaration *param_decl = IMPORT_NEW(Ast_Declaration);
+                param_decl->identifier = make_identifier(compiler, compiler->make_atom(param->name));
+                param_decl->type_info = get_jiyu_type(import, param->type);
+
+                function->arguments.add(param_decl);
             }
 
+            function->linkage_name = decl->linkage_name;
+
             function->return_type = IMPORT_NEW(Ast_Type_Instantiation);
             function->return_type->type_info  = compiler->type_info_type;
-            function->return_type->type_value = get_jiyu_type(visitor_data, clang_getCursorResultType(cursor)); // @Hack
+            function->return_type->type_value = get_jiyu_type(import, decl->type); // @Hack
 
             // We should maybe make get_jiyu_type work for the function prototype type, but
             // doing this for now just to get things going.
             function->type_info = compiler->make_function_type(function);
 
-            current_scope->statements.add(function);
-            current_scope->declarations.add(function);
+            add_to_scope(import, scope, function);
             break;
         }
 
-        case CXCursor_TypedefDecl: {
-            Ast_Type_Alias *alias = IMPORT_NEW(Ast_Type_Alias);
-            add_usr_mapping(usr_map, my_usr_string, alias);
+        case C_DECL_TYPEDEF: {
+            auto info = get_jiyu_type(import, decl->type);
 
-            CXString cxstring = clang_getCursorSpelling(cursor);
-            defer { clang_disposeString(cxstring); };
+            // The underlying type may have referenced this typedef through a pointer.
+            if (decl->ast) return decl->ast;
 
-            String name = to_string(clang_getCString(cxstring));
-            // printf("Alias name: %.*s\n", PRINT_ARG(name));
-
-            Atom *name_atom = compiler->make_atom(name);
-            alias->identifier = make_identifier(compiler, name_atom);
-            alias->identifier->enclosing_scope = current_scope;
+            Ast_Type_Alias *alias = IMPORT_NEW(Ast_Type_Alias);
+            decl->ast = alias;
 
-            CXType   underlying_type = clang_getTypedefDeclUnderlyingType(cursor);
+            set_identifier(compiler, alias, decl->name, scope);
 
-            auto info = get_jiyu_type(visitor_data, underlying_type);
-            assert(info);
             alias->type_value = compiler->make_type_alias_type(info);
             alias->type_value->alias_decl = alias;
 
-            current_scope->statements.add(alias);
-            current_scope->declarations.add(alias);
+            add_to_scope(import, scope, alias);
             break;
         }
 
-        case CXCursor_EnumDecl: {
-            // @TODO since we do not have enums yet, just import the type of the enum as
-            // a typealias to the underlying C type and import enumerates as lets.
+        case C_DECL_ENUM: {
             Ast_Type_Alias *alias = IMPORT_NEW(Ast_Type_Alias);
-            add_usr_mapping(usr_map, my_usr_string, alias);
+            decl->ast = alias;
 
-            CXString cxstring = clang_getCursorSpelling(cursor);
-            defer { clang_disposeString(cxstring); };
+            set_identifier(compiler, alias, decl->name, scope);
 
-            String name = to_string(clang_getCString(cxstring));
-            // printf("Alias name: %.*s\n", PRINT_ARG(name));
+            alias->type_value = compiler->make_type_alias_type(get_jiyu_type(import, decl->type));
+            alias->type_value->alias_decl = alias;
 
-            Atom *name_atom = compiler->make_atom(name);
-            alias->identifier = make_identifier(compiler, name_atom);
-            alias->identifier->enclosing_scope = current_scope;
+            add_to_scope(import, scope, alias);
 
-            CXType underlying_type = clang_getEnumDeclIntegerType(cursor);
+            for (s32 i = 0; i < decl->member_count; ++i) {
+                materialize_declaration(import, import->indices[decl->first_member + i], scope);
+            }
+            break;
+        }
 
-            auto info = get_jiyu_type(visitor_data, underlying_type);
-            assert(info);
-            alias->type_value = compiler->make_type_alias_type(info);
-            alias->type_value->alias_decl = alias;
+        case C_DECL_ENUM_CONSTANT: {
+            Ast_Declaration *constant = IMPORT_NEW(Ast_Declaration);
+            decl->ast = constant;
 
-            current_scope->statements.add(alias);
-            current_scope->declarations.add(alias);
+            set_identifier(compiler, constant, decl->name, scope);
 
-            Visitor_Data data;
-            data.compiler = compiler;
-            data.target_scope = visitor_data->target_scope; // @TODO
-            data.usr_map = usr_map;
+            Ast_Type_Info *info = get_jiyu_type(import, decl->type);
 
-            clang_visitChildren(cursor, cursor_visitor, &data);
+            constant->initializer_expression = make_integer_literal(compiler, decl->value, info);
+            constant->is_let = true;
+            constant->is_readonly_variable = false;
+            constant->type_info = info;
 
+            add_to_scope(import, scope, constant);
             break;
         }
 
-        case CXCursor_EnumConstantDecl: {
-            Ast_Declaration *decl = IMPORT_NEW(Ast_Declaration);
+        case C_DECL_STRUCT: {
+            Ast_Struct *_struct = IMPORT_NEW(Ast_Struct);
+            decl->ast = _struct;
 
-            CXString cxstring = clang_getCursorSpelling(cursor);
-            defer { clang_disposeString(cxstring); };
+            _struct->is_union = decl->is_union;
+            _struct->is_anonymous = decl->is_anonymous;
+            _struct->type_value = make_struct_type(compiler, _struct);
 
-            String name = to_string(clang_getCString(cxstring));
-            // printf("Field name: %.*s\n", PRINT_ARG(name));
+            if (!decl->is_filled) break; // Only a forward declaration was seen, so this is only usable through pointers.
 
-            if (name != String()) {
-                Atom *name_atom = compiler->make_atom(name);
-                decl->identifier = make_identifier(compiler, name_atom);
-                decl->identifier->enclosing_scope = current_scope;
+            {
+                auto type_value = _struct->type_value;
+                type_value->size = decl->size;
+                type_value->stride = type_value->size;
+                type_value->alignment = decl->alignment;
             }
 
-            CXType type = clang_getCursorType(cursor);
-            Ast_Type_Info *info = get_jiyu_type(visitor_data, type);
+            _struct->member_scope.parent = scope;
+            set_identifier(compiler, _struct, decl->name, scope);
+
+            for (s32 i = 0; i < decl->member_count; ++i) {
+                materialize_declaration(import, import->indices[decl->first_member + i], &_struct->member_scope);
+            }
 
-            decl->initializer_expression = make_integer_literal(compiler, clang_getEnumConstantDeclValue(cursor), info);
-            decl->is_let = true;
-            decl->is_readonly_variable = false;
-            // decl->is_struct_member = true; // This will be set via typechecking anyways..
-            decl->type_info = info;
+            // @Incomplete add to type-map
+            add_to_scope(import, scope, _struct);
 
-            current_scope->statements.add(decl);
-            current_scope->declarations.add(decl);
+            // Nested structs are typechecked along with their parent.
+            if (scope == import->target_scope) import->pending_structs.add(_struct);
             break;
         }
 
-        case CXCursor_UnionDecl:
-        case CXCursor_StructDecl: {
-            if (find_ast(usr_map, my_usr_string) && !clang_isCursorDefinition(cursor)) {
-                break; // Skip, we've already filled the type.
+        case C_DECL_FIELD: {
+            Ast_Declaration *field = IMPORT_NEW(Ast_Declaration);
+            decl->ast = field;
+
+            set_identifier(compiler, field, decl->name, scope);
+
+            field->is_let = false;
+            field->is_readonly_variable = false;
+            // field->is_struct_member = true; // This will be set via typechecking anyways..
+            field->type_info = get_jiyu_type(import, decl->type);
+
+            if (decl->is_bitfield) {
+                // @FixMe report error in a better way
+                compiler->report_error((Token *)nullptr, "Bitfields are unsupported. Found while importing code at %.*s\n", PRINT_ARG(decl->location));
             }
 
-            Ast_Struct *_struct = nullptr;
-            if (auto ast = find_ast(usr_map, my_usr_string)) {
-                _struct = static_cast<Ast_Struct *>(ast);
-            } else {
-                _struct = IMPORT_NEW(Ast_Struct);
-                _struct->is_union = (cursor.kind == CXCursor_UnionDecl);
-                _struct->is_anonymous = (clang_Cursor_isAnonymousRecordDecl(cursor) != 0);
-                _struct->type_value = make_struct_type(compiler, _struct);
+            add_to_scope(import, scope, field);
+            break;
+        }
 
-                // Do not add anonymous records to USR mappings,
-                // because two anonymous records in the same scope
-                // have the same USR mapping (and because we will not be referenced by variable declarations).
-                if (!_struct->is_anonymous) add_usr_mapping(usr_map, my_usr_string, _struct);
+        case C_DECL_PARAMETER: {
+            assert(false); // Parameters are created along with their function.
+            break;
+        }
+    }
 
-                if (_struct->is_anonymous) assert(clang_isCursorDefinition(cursor));
+    return decl->ast;
+}
+
+void materialize_clang_declarations(Compiler *compiler, Ast_Scope *scope, Atom *name) {
+    for (auto import = scope->lazy_c_imports; import; import = import->next) {
+        auto &bucket = import->name_buckets[name->hash & (CLANG_NAME_BUCKET_COUNT-1)];
+
+        for (array_count_type i = 0; i < bucket.count;) {
+            auto entry = bucket[i];
+            if (entry.hash != name->hash || entry.name != name->name) {
+                ++i;
+                continue;
             }
 
-            assert(_struct->type == AST_STRUCT);
+            // Remove the name before materializing so each one is only ever converted once.
+            bucket.ordered_remove(i);
 
-            if (clang_isCursorDefinition(cursor) || clang_Cursor_isNull(clang_getCursorDefinition(cursor))) {
-                {
-                    auto cursor_type = clang_getCursorType(cursor);
-                    auto type_value = _struct->type_value;
-                    type_value->size = clang_Type_getSizeOf(cursor_type);
-                    type_value->stride = type_value->size;
-                    type_value->alignment = clang_Type_getAlignOf(cursor_type);
-                }
+            MICROPROFILE_SCOPEI("clang", "materialize_declaration", -1);
+            materialize_declaration(import, entry.decl, import->target_scope);
+        }
+
+        // Typecheck structs now, since ones that were only reached through the types
+        // of other declarations would otherwise never be typechecked.
+        while (import->pending_structs.count) {
+            auto _struct = import->pending_structs.pop();
+            compiler->sema->typecheck_expression(_struct);
+        }
+    }
+}
 
-                _struct->member_scope.parent = current_scope;
+// Quoted #includes resolve relative to the directory of the main file, and relative -I paths to the
+// working directory, so the same source can see different headers depending on where it is compiled.
+static
+void hash_include_locations(llvm::MD5 *hash, char *c_filepath) {
+    llvm::SmallString<256> directory(c_filepath);
+    llvm::sys::fs::make_absolute(directory);
+    llvm::sys::path::remove_filename(directory);
+    hash->update(llvm::StringRef(directory.c_str(), directory.size() + 1));
+
+    llvm::SmallString<256> working_directory;
+    if (!llvm::sys::fs::current_path(working_directory)) {
+        hash->update(llvm::StringRef(working_directory.c_str(), working_directory.size() + 1));
+    }
+}
 
-                CXString cxstring = clang_getCursorSpelling(cursor);
-                defer { clang_disposeString(cxstring); };
+// The cache of import records is keyed on the C source, the directories its includes resolve against,
+// the clang command line and the target triple.
+// It also stores the headers the source included, so it is invalidated when one of them changes.
+const u32 CLANG_IMPORT_CACHE_MAGIC   = 0x49435953; // "JYCI" @Volatile bump CLANG_IMPORT_CACHE_VERSION when the record layout changes.
+const u32 CLANG_IMPORT_CACHE_VERSION = 1;
 
-                String name = to_string(clang_getCString(cxstring));
-                // printf("Struct name: %.*s\n", PRINT_ARG(name));
+struct Cached_Include {
+    String path;
+    s64    modification_time;
+    u64    size;
+};
 
-                if (name != String()) {
-                    Atom *name_atom = compiler->make_atom(name);
-                    _struct->identifier = make_identifier(compiler, name_atom);
-                    _struct->identifier->enclosing_scope = current_scope;
-                }
+static
+String get_import_cache_path(Compiler *compiler, char *c_filepath, String source, Array<char *> *args) {
+    llvm::MD5 hash;
+    hash.update(llvm::StringRef(source.data, source.length));
+    hash_include_locations(&hash, c_filepath);
 
-                Visitor_Data data;
-                data.compiler = compiler;
-                data.target_scope = &_struct->member_scope;
-                data.usr_map = usr_map;
+    for (auto arg : *args) {
+        hash.update(llvm::StringRef(arg, strlen(arg) + 1)); // Include the terminator so argument boundaries are hashed.
+    }
 
-                clang_visitChildren(cursor, cursor_visitor, &data);
+    hash.update(compiler->llvm_gen->TargetMachine->getTargetTriple().str());
 
-                // @Incomplete add to type-map
-                current_scope->statements.add(_struct);
-                current_scope->declarations.add(_struct);
-            }
-            break;
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+
+    llvm::SmallString<32> digest;
+    llvm::MD5::stringifyResult(result, digest);
+
+    return mprintf("%.*s/clang_%s.imports", PRINT_ARG(compiler->build_options.cache_directory), digest.c_str());
+}
+
+static
+bool get_include_status(String path, Cached_Include *include) {
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(llvm::StringRef(path.data, path.length), status)) return false;
+
+    include->path = path;
+    include->modification_time = static_cast<s64>(llvm::sys::toTimeT(status.getLastModificationTime()));
+    include->size = status.getSize();
+    return true;
+}
+
+static
+void collect_inclusion(CXFile included_file, CXSourceLocation *inclusion_stack, unsigned include_length, CXClientData client_data) {
+    auto includes = reinterpret_cast<Array<String> *>(client_data);
+
+    // The main file is covered by the cache key, and does not have to exist on disk.
+    if (include_length == 0) return;
+
+    CXString cxstring = clang_getFileName(included_file);
+    includes->add(copy_string(to_string(clang_getCString(cxstring))));
+    clang_disposeString(cxstring);
+}
+
+template <typename T>
+static
+void write_value(String_Builder *builder, T value) {
+    String s;
+    s.data   = reinterpret_cast<char *>(&value);
+    s.length = sizeof(T);
+    builder->append(s);
+}
+
+static
+void write_string(String_Builder *builder, String s) {
+    write_value<u32>(builder, static_cast<u32>(s.length));
+    builder->append(s);
+}
+
+// Returns false if the cache could not be written.
+static
+bool save_import_cache(Compiler *compiler, Clang_Lazy_Import *import, CXTranslationUnit translation_unit, String cache_path) {
+    MICROPROFILE_SCOPEI("clang", "save_import_cache", -1);
+
+    Array<String> include_paths;
+    clang_getInclusions(translation_unit, collect_inclusion, &include_paths);
+
+    String_Builder builder;
+    write_value<u32>(&builder, CLANG_IMPORT_CACHE_MAGIC);
+    write_value<u32>(&builder, CLANG_IMPORT_CACHE_VERSION);
+
+    write_value<u32>(&builder, include_paths.count);
+    for (auto path : include_paths) {
+        Cached_Include include;
+        if (!get_include_status(path, &include)) return false;
+
+        write_string(&builder, include.path);
+        write_value<s64>(&builder, include.modification_time);
+        write_value<u64>(&builder, include.size);
+    }
+
+    write_value<u32>(&builder, import->types.count);
+    for (auto &type : import->types) {
+        write_value<u8> (&builder, type.kind);
+        write_value<u8> (&builder, type.is_varargs);
+        write_value<s64>(&builder, type.size);
+        write_value<s32>(&builder, type.element);
+        write_value<s32>(&builder, type.declaration);
+        write_value<s32>(&builder, type.first_argument);
+        write_value<s32>(&builder, type.argument_count);
+    }
+
+    write_value<u32>(&builder, import->decls.count);
+    for (auto &decl : import->decls) {
+        u8 flags = (decl.is_varargs << 0) | (decl.is_union << 1) | (decl.is_anonymous << 2) | (decl.is_filled << 3) | (decl.is_bitfield << 4);
+
+        write_value<u8> (&builder, decl.kind);
+        write_value<u8> (&builder, flags);
+        write_string(&builder, decl.name);
+        write_string(&builder, decl.filename);
+        write_string(&builder, decl.linkage_name);
+        write_string(&builder, decl.location);
+        write_value<s32>(&builder, decl.type);
+        write_value<s64>(&builder, decl.value);
+        write_value<s64>(&builder, decl.size);
+        write_value<s64>(&builder, decl.alignment);
+        write_value<s32>(&builder, decl.first_member);
+        write_value<s32>(&builder, decl.member_count);
+    }
+
+    write_value<u32>(&builder, import->indices.count);
+    for (auto index : import->indices) write_value<s32>(&builder, index);
+
+    write_value<u32>(&builder, import->names.count);
+    for (auto &name : import->names) {
+        write_string(&builder, name.name);
+        write_value<s32>(&builder, name.decl);
+    }
+
+    if (llvm::sys::fs::create_directories(compiler->get_temp_c_string(compiler->build_options.cache_directory))) return false;
+
+    // Write to an instance-specific file and rename it into place, so compilers sharing
+    // a cache directory never observe a partially written cache.
+    String temp_path = mprintf("%.*s.w%d.tmp", PRINT_ARG(cache_path), (int)compiler->instance_number);
+    defer { free(temp_path.data); };
+
+    String contents = builder.to_string();
+    defer { free(contents.data); };
+
+    {
+        std::error_code error;
+        llvm::raw_fd_ostream out(llvm::StringRef(temp_path.data, temp_path.length), error, llvm::sys::fs::F_None);
+        if (error) return false;
+
+        out.write(contents.data, contents.length);
+        out.close();
+
+        if (out.has_error()) {
+            out.clear_error();
+            llvm::sys::fs::remove(llvm::StringRef(temp_path.data, temp_path.length));
+            return false;
         }
+    }
 
-        case CXCursor_FieldDecl: {
-            Ast_Declaration *decl = IMPORT_NEW(Ast_Declaration);
+    if (llvm::sys::fs::rename(llvm::StringRef(temp_path.data, temp_path.length), llvm::StringRef(cache_path.data, cache_path.length))) {
+        llvm::sys::fs::remove(llvm::StringRef(temp_path.data, temp_path.length));
+        return false;
+    }
 
-            CXString cxstring = clang_getCursorSpelling(cursor);
-            defer { clang_disposeString(cxstring); };
+    return true;
+}
 
-            String name = to_string(clang_getCString(cxstring));
-            // printf("Field name: %.*s\n", PRINT_ARG(name));
+struct Cache_Reader {
+    Compiler *compiler;
+    String data;
+    bool failed = false;
+
+    template <typename T>
+    T read() {
+        T value = T();
+        if (failed || data.length < (string_length_type)sizeof(T)) {
+            failed = true;
+            return value;
+        }
 
-            if (name != String()) {
-                Atom *name_atom = compiler->make_atom(name);
-                decl->identifier = make_identifier(compiler, name_atom);
-                decl->identifier->enclosing_scope = current_scope;
-            }
+        memcpy(&value, data.data, sizeof(T));
+        advance(&data, sizeof(T));
+        return value;
+    }
+
+    String read_string() {
+        u32 length = read<u32>();
+        if (failed || data.length < (string_length_type)length) {
+            failed = true;
+            return String();
+        }
 
-            CXType type = clang_getCursorType(cursor);
-            Ast_Type_Info *info = get_jiyu_type(visitor_data, type);
+        String result;
+        result.data   = data.data;
+        result.length = length;
+        advance(&data, length);
+        return compiler->copy_string(result);
+    }
+};
 
-            decl->is_let = false;
-            decl->is_readonly_variable = false;
-            // decl->is_struct_member = true; // This will be set via typechecking anyways..
-            decl->type_info = info;
+// Returns false if there is no usable cache, in which case _import_ is left in an unspecified state.
+static
+bool load_import_cache(Compiler *compiler, Clang_Lazy_Import *import, String cache_path) {
+    MICROPROFILE_SCOPEI("clang", "load_import_cache", -1);
 
-            if (clang_Cursor_isBitField(cursor)) {
-                // @FixMe report error in a better way
-                auto filename = copy_and_dispose(compiler, clang_getFileName(file));
-                compiler->report_error((Token *)nullptr, "Bitfields are unsupported. Found while importing code at %.*s:%u:%u\n", PRINT_ARG(filename), line, column);
+    bool read_entire_file(String filepath, String *result);
+
+    String contents;
+    if (!read_entire_file(cache_path, &contents)) return false;
+    defer { free(contents.data); };
+
+    Cache_Reader reader;
+    reader.compiler = compiler;
+    reader.data = contents;
+
+    if (reader.read<u32>() != CLANG_IMPORT_CACHE_MAGIC)   return false;
+    if (reader.read<u32>() != CLANG_IMPORT_CACHE_VERSION) return false;
+
+    u32 include_count = reader.read<u32>();
+    for (u32 i = 0; i < include_count && !reader.failed; ++i) {
+        Cached_Include cached;
+        cached.path = reader.read_string();
+        cached.modification_time = reader.read<s64>();
+        cached.size = reader.read<u64>();
+
+        Cached_Include current;
+        if (!get_include_status(cached.path, &current)) return false;
+        if (current.modification_time != cached.modification_time || current.size != cached.size) return false;
+    }
+
+    u32 type_count = reader.read<u32>();
+    for (u32 i = 0; i < type_count && !reader.failed; ++i) {
+        C_Type type;
+        type.kind           = static_cast<C_Type_Kind>(reader.read<u8>());
+        type.is_varargs     = reader.read<u8>() != 0;
+        type.size           = reader.read<s64>();
+        type.element        = reader.read<s32>();
+        type.declaration    = reader.read<s32>();
+        type.first_argument = reader.read<s32>();
+        type.argument_count = reader.read<s32>();
+        import->types.add(type);
+    }
+
+    u32 decl_count = reader.read<u32>();
+    for (u32 i = 0; i < decl_count && !reader.failed; ++i) {
+        C_Decl decl;
+        decl.kind = static_cast<C_Decl_Kind>(reader.read<u8>());
+
+        u8 flags = reader.read<u8>();
+        decl.is_varargs   = (flags & (1 << 0)) != 0;
+        decl.is_union     = (flags & (1 << 1)) != 0;
+        decl.is_anonymous = (flags & (1 << 2)) != 0;
+        decl.is_filled    = (flags & (1 << 3)) != 0;
+        decl.is_bitfield  = (flags & (1 << 4)) != 0;
+
+        decl.name         = reader.read_string();
+        decl.filename     = reader.read_string();
+        decl.linkage_name = reader.read_string();
+        decl.location     = reader.read_string();
+        decl.type         = reader.read<s32>();
+        decl.value        = reader.read<s64>();
+        decl.size         = reader.read<s64>();
+        decl.alignment    = reader.read<s64>();
+        decl.first_member = reader.read<s32>();
+        decl.member_count = reader.read<s32>();
+        import->decls.add(decl);
+    }
+
+    u32 index_count = reader.read<u32>();
+    for (u32 i = 0; i < index_count && !reader.failed; ++i) {
+        import->indices.add(reader.read<s32>());
+    }
+
+    u32 name_count = reader.read<u32>();
+    for (u32 i = 0; i < name_count && !reader.failed; ++i) {
+        C_Name name;
+        name.name = reader.read_string();
+        name.hash = compiler->atom_table->hash_key(name.name);
+        name.decl = reader.read<s32>();
+        import->names.add(name);
+    }
+
+    if (reader.failed || reader.data.length != 0) return false;
+
+    // Validate every index so a damaged cache cannot make us read out of bounds later.
+    auto valid_type = [&](s32 index) { return index >= 0 && index < import->types.count; };
+    auto valid_decl = [&](s32 index) { return index >= 0 && index < import->decls.count; };
+    auto valid_range = [&](s32 first, s32 count) { return first >= 0 && count >= 0 && first <= import->indices.count - count; };
+
+    for (auto &type : import->types) {
+        if (type.kind > C_TYPE_DECLARATION) return false;
+        if ((type.kind == C_TYPE_POINTER || type.kind == C_TYPE_ARRAY || type.kind == C_TYPE_FUNCTION) && !valid_type(type.element)) return false;
+        if (type.kind == C_TYPE_DECLARATION && !valid_decl(type.declaration)) return false;
+        if (type.kind == C_TYPE_FUNCTION) {
+            if (!valid_range(type.first_argument, type.argument_count)) return false;
+            for (s32 i = 0; i < type.argument_count; ++i) {
+                if (!valid_type(import->indices[type.first_argument + i])) return false;
             }
+        }
+    }
 
-            current_scope->statements.add(decl);
-            current_scope->declarations.add(decl);
-            break;
+    for (auto &decl : import->decls) {
+        if (decl.kind > C_DECL_FIELD) return false;
+        if (decl.kind != C_DECL_STRUCT && !valid_type(decl.type)) return false;
+        if (!valid_range(decl.first_member, decl.member_count)) return false;
+        for (s32 i = 0; i < decl.member_count; ++i) {
+            if (!valid_decl(import->indices[decl.first_member + i])) return false;
         }
+    }
 
-        default: {
-            CXString cxstring = clang_getCursorSpelling(cursor);
-            defer { clang_disposeString(cxstring); };
+    for (auto &name : import->names) {
+        if (!valid_decl(name.decl)) return false;
+    }
 
-            String name = to_string(clang_getCString(cxstring));
-            if (compiler->build_options.verbose_diagnostics) printf("Unahndled CXCursor in cursor_visitor. kind: %s, name: %.*s. This is a message for maintainers.\n", clang_getCString(kind_string), PRINT_ARG(name));
-            break;
-        }
+    if (compiler->build_options.verbose_diagnostics) printf("Reusing cached C import %.*s\n", PRINT_ARG(cache_path));
+    return true;
+}
+
+static
+CXIndex get_clang_index(Compiler *compiler) {
+    // One index is shared by all imports of a compiler instance so libclang can
+    // reuse its file manager and loaded ASTs between imports.
+    if (!compiler->clang_index) {
+        compiler->clang_index = clang_createIndex(/*excludeDeclarationsFromPCH=*/0, /*displayDiagnostics=*/0);
     }
 
-    return CXChildVisit_Continue;
+    return compiler->clang_index;
 }
 
+void shutdown_clang_import(Compiler *compiler) {
+    for (auto import : compiler->clang_lazy_imports) {
+        delete import;
+    }
+    compiler->clang_lazy_imports.reset();
 
-bool perform_clang_import(Compiler *compiler, char *c_filepath, Ast_Scope *target_scope) {
+    if (compiler->clang_index) {
+        clang_disposeIndex(compiler->clang_index);
+        compiler->clang_index = nullptr;
+    }
+}
+
+// Precompiled C ASTs are keyed on the C source, the directories its includes resolve against, the clang
+// command line and the libclang version, so each unique header set and set of flags gets its own file
+// in the cache directory.
+static
+String get_precompiled_ast_path(Compiler *compiler, char *c_filepath, String source, Array<char *> *args) {
+    llvm::MD5 hash;
+    hash.update(llvm::StringRef(source.data, source.length));
+    hash_include_locations(&hash, c_filepath);
+
+    for (auto arg : *args) {
+        hash.update(llvm::StringRef(arg, strlen(arg) + 1)); // Include the terminator so argument boundaries are hashed.
+    }
+
+    {
+        CXString version = clang_getClangVersion();
+        hash.update(llvm::StringRef(clang_getCString(version)));
+        clang_disposeString(version);
+    }
+
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+
+    llvm::SmallString<32> digest;
+    llvm::MD5::stringifyResult(result, digest);
+
+    return mprintf("%.*s/clang_%s.ast", PRINT_ARG(compiler->build_options.cache_directory), digest.c_str());
+}
+
+struct Inclusion_Check {
+    llvm::sys::TimePoint<> ast_time;
+    bool is_stale = false;
+};
+
+static
+void check_inclusion_time(CXFile included_file, CXSourceLocation *inclusion_stack, unsigned include_length, CXClientData client_data) {
+    auto check = reinterpret_cast<Inclusion_Check *>(client_data);
+
+    // The main file is covered by the cache key, and does not have to exist on disk.
+    if (include_length == 0) return;
+
+    CXString cxstring = clang_getFileName(included_file);
+    defer { clang_disposeString(cxstring); };
+
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(clang_getCString(cxstring), status) || status.getLastModificationTime() > check->ast_time) {
+        check->is_stale = true;
+    }
+}
+
+// Returns nullptr if there is no precompiled AST or if any of the headers it was built from has changed since.
+static
+CXTranslationUnit load_precompiled_ast(Compiler *compiler, String ast_path) {
+    MICROPROFILE_SCOPEI("clang", "load_precompiled_ast", -1);
+
+    char *c_ast_path = compiler->get_temp_c_string(ast_path);
+
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(c_ast_path, status)) return nullptr;
+
+    CXTranslationUnit translation_unit = nullptr;
+    CXErrorCode error = clang_createTranslationUnit2(get_clang_index(compiler), c_ast_path, &translation_unit);
+    if (error != CXError_Success) return nullptr;
+
+    Inclusion_Check check;
+    check.ast_time = status.getLastModificationTime();
+    clang_getInclusions(translation_unit, check_inclusion_time, &check);
+
+    if (check.is_stale) {
+        clang_disposeTranslationUnit(translation_unit);
+        return nullptr;
+    }
+
+    if (compiler->build_options.verbose_diagnostics) printf("Reusing precompiled C AST %.*s\n", PRINT_ARG(ast_path));
+    return translation_unit;
+}
+
+static
+void save_precompiled_ast(Compiler *compiler, CXTranslationUnit translation_unit, String ast_path) {
+    MICROPROFILE_SCOPEI("clang", "save_precompiled_ast", -1);
+
+    if (llvm::sys::fs::create_directories(compiler->get_temp_c_string(compiler->build_options.cache_directory))) return;
+
+    // Save to an instance-specific file and rename it into place, so compilers sharing
+    // a cache directory never observe a partially written AST.
+    String temp_path = mprintf("%.*s.w%d.tmp", PRINT_ARG(ast_path), (int)compiler->instance_number);
+    defer { free(temp_path.data); };
+
+    char *c_temp_path = to_c_string(temp_path);
+    defer { free(c_temp_path); };
+
+    int error = clang_saveTranslationUnit(translation_unit, c_temp_path, clang_defaultSaveOptions(translation_unit));
+    if (error != CXSaveError_None) {
+        llvm::sys::fs::remove(c_temp_path);
+        return;
+    }
+
+    if (llvm::sys::fs::rename(c_temp_path, compiler->get_temp_c_string(ast_path))) {
+        llvm::sys::fs::remove(c_temp_path);
+    }
+}
+
+// _source_ is the contents of _c_filepath_. If _unsaved_file_ is set, it holds the same contents and
+// _c_filepath_ does not need to exist on disk.
+static
+bool perform_clang_import(Compiler *compiler, char *c_filepath, String source, CXUnsavedFile *unsaved_file, Ast_Scope *target_scope) {
     MICROPROFILE_SCOPEI("clang", "perform_import", -1);
-    CXIndex index = clang_createIndex(/*excludeDeclarationsFromPCH=*/0, /*displayDiagnostics=*/0);
 
     // @Incomplete
     Array<char *> clang_command_line_args;
@@ -580,9 +1448,9 @@ bool perform_clang_import(Compiler *compiler, char *c_filepath, Ast_Scope *targe
         clang_command_line_args.add(to_c_string(lib_search_path)); // @Leak
     }
 
+#ifdef MACOSX
     auto triple = compiler->llvm_gen->TargetMachine->getTargetTriple();
 
-#ifdef MACOSX
     // One MacOSX, we have to explicitly set the sysroot with custom-built versions of clang.
     // A more reliable solution would be to use the xcrun tool, I think:
     // -isysroot $(xcrun --sdk iphoneos --show-sdk-path)
@@ -594,80 +1462,114 @@ bool perform_clang_import(Compiler *compiler, char *c_filepath, Ast_Scope *targe
     }
 #endif
 
-    CXTranslationUnit translation_unit;
-    CXErrorCode error = clang_parseTranslationUnit2(index,
-                            c_filepath,
-                            clang_command_line_args.data,
-                            clang_command_line_args.count,
-                            /*unsaved_files=*/nullptr,
-                            /*num_unsaved_files=*/0,
-                            CXTranslationUnit_None,
-                            &translation_unit);
-
-    defer {
-        clang_disposeTranslationUnit(translation_unit);
-        clang_disposeIndex(index);
-    };
+    Clang_Lazy_Import *import = new Clang_Lazy_Import();
+    import->compiler     = compiler;
+    import->target_scope = target_scope;
 
-    if (error != 0) return false;
+    compiler->clang_lazy_imports.add(import);
 
-    for (unsigned i = 0; i < clang_getNumDiagnostics(translation_unit); ++i) {
-        CXDiagnostic diag = clang_getDiagnostic(translation_unit, i);
-        CXString diag_string = clang_formatDiagnostic(diag, CXDiagnostic_DisplaySourceLocation | CXDiagnostic_DisplayColumn);
+    String cache_path = get_import_cache_path(compiler, c_filepath, source, &clang_command_line_args);
+    defer { free(cache_path.data); };
 
-        // @Incomplete what we really want is to use Jiyu's error reporting system.
-        printf("%s\n", clang_getCString(diag_string));
-        clang_disposeString(diag_string);
+    // A warm cache does not need libclang at all.
+    if (!load_import_cache(compiler, import, cache_path)) {
+        import->types.reset();
+        import->decls.reset();
+        import->indices.reset();
+        import->names.reset();
 
-        auto severity = clang_getDiagnosticSeverity(diag);
-        if ((severity == CXDiagnostic_Error) || (severity == CXDiagnostic_Fatal)) {
-            compiler->errors_reported += 1;
+        String ast_path = get_precompiled_ast_path(compiler, c_filepath, source, &clang_command_line_args);
+        defer { free(ast_path.data); };
+
+        CXTranslationUnit translation_unit = load_precompiled_ast(compiler, ast_path);
+
+        bool is_precompiled = (translation_unit != nullptr);
+
+        CXErrorCode error = CXError_Success;
+        if (!is_precompiled) {
+            // We only need declarations, so skip parsing function bodies (static inline functions in headers can be a large portion of the work).
+            // The file is treated as an incomplete translation unit because it usually consists of only headers.
+            unsigned options = CXTranslationUnit_SkipFunctionBodies | CXTranslationUnit_Incomplete | CXTranslationUnit_ForSerialization;
+
+            error = clang_parseTranslationUnit2(get_clang_index(compiler),
+                                c_filepath,
+                                clang_command_line_args.data,
+                                clang_command_line_args.count,
+                                unsaved_file,
+                                unsaved_file ? 1 : 0,
+                                options,
+                                &translation_unit);
         }
-    }
 
-    if (compiler->errors_reported) return false;
+        defer {
+            if (translation_unit) clang_disposeTranslationUnit(translation_unit);
+        };
 
-    String filename; // @Hack for IMPORT_NEW
+        if (error != 0) return false;
 
-    Array<USR_Pair> usr_map;
-    Visitor_Data    data;
-    data.compiler     = compiler;
-    data.target_scope = target_scope;
-    data.usr_map      = &usr_map;
+        for (unsigned i = 0; i < clang_getNumDiagnostics(translation_unit); ++i) {
+            CXDiagnostic diag = clang_getDiagnostic(translation_unit, i);
+            CXString diag_string = clang_formatDiagnostic(diag, CXDiagnostic_DisplaySourceLocation | CXDiagnostic_DisplayColumn);
 
-    // @Cleanup these built-in C declarations should exist in a specific shared scope
-    // for all C imports, otherwise we are widening the surface area of duplication in
-    // the same scope by default.
+            // @Incomplete what we really want is to use Jiyu's error reporting system.
+            printf("%s\n", clang_getCString(diag_string));
+            clang_disposeString(diag_string);
 
-    // Add __va_list_tag; I haven't experienced needing this on Windows, I am presuming it is a legacy thing
-    // that exists in older Linux/Mac/BSD code. -josh 3 January 2020
-    if (!triple.isOSWindows()) {
-        // @Cutnpaste from the cursor_visitor
-        Ast_Struct *_struct = IMPORT_NEW(Ast_Struct);
-        _struct->is_union = false;
-        _struct->type_value = make_struct_type(compiler, _struct);
-        add_usr_mapping(&usr_map, to_string("c:@S@__va_list_tag"), _struct);
+            auto severity = clang_getDiagnosticSeverity(diag);
+            if ((severity == CXDiagnostic_Error) || (severity == CXDiagnostic_Fatal)) {
+                compiler->errors_reported += 1;
+            }
+        }
 
-        target_scope->statements.add(_struct);
-        target_scope->declarations.add(_struct);
-    }
+        if (compiler->errors_reported) return false;
 
-    // Add __builtin_va_list definition (officially *void under GCC/Clang, idk if this is true under Windows for Clang @TODO)
-    {
-        // @Cutnpaste from the cursor_visitor
-        Ast_Type_Alias *alias = IMPORT_NEW(Ast_Type_Alias);
-        add_usr_mapping(&usr_map, to_string("c:@T@__builtin_va_list"), alias);
-        alias->type_info = compiler->type_info_type;
+        // Everything we need from the translation unit is copied into the records, so it is
+        // disposed as soon as they are built.
+        build_records(compiler, import, translation_unit);
 
-        auto info = compiler->type_ptr_void;
-        alias->type_value = compiler->make_type_alias_type(info);
-        alias->type_value->alias_decl = alias;
+        // The import cache makes the precompiled AST redundant, it is only kept for when the records could not be saved.
+        bool saved_import_cache = save_import_cache(compiler, import, translation_unit, cache_path);
+        if (!saved_import_cache && !is_precompiled) save_precompiled_ast(compiler, translation_unit, ast_path);
+    }
 
-        target_scope->statements.add(alias);
-        target_scope->declarations.add(alias);
+    // Declarations are converted to AST the first time sema looks up their name.
+    // Most programs only use a few of the declarations in a header.
+    for (auto &name : import->names) {
+        import->name_buckets[name.hash & (CLANG_NAME_BUCKET_COUNT-1)].add(name);
     }
 
-    clang_visitChildren(clang_getTranslationUnitCursor(translation_unit), cursor_visitor, &data);
+    import->next = target_scope->lazy_c_imports;
+    target_scope->lazy_c_imports = import;
 
     return true;
 }
+
+bool perform_clang_import(Compiler *compiler, char *c_filepath, Ast_Scope *target_scope) {
+    bool read_entire_file(String filepath, String *result);
+
+    String source;
+    if (!read_entire_file(to_string(c_filepath), &source)) {
+        compiler->report_error((Token *)nullptr, "Could not read C file '%s'.\n", c_filepath);
+        return false;
+    }
+    defer { free(source.data); };
+
+    return perform_clang_import(compiler, c_filepath, source, nullptr, target_scope);
+}
+
+bool perform_clang_import_string(Compiler *compiler, String string_to_compile, Ast_Scope *target_scope) {
+    // The source is handed to libclang as an unsaved file, so nothing is written to disk. The path is
+    // relative to the working directory, so quoted #includes resolve the same way they would for a file there.
+    String path = mprintf(".w%d_clang_import.c", (int)compiler->instance_number);
+    defer { free(path.data); };
+
+    char *c_path = to_c_string(path);
+    defer { free(c_path); };
+
+    CXUnsavedFile unsaved_file;
+    unsaved_file.Filename = c_path;
+    unsaved_file.Contents = string_to_compile.data;
+    unsaved_file.Length   = static_cast<unsigned long>(string_to_compile.length);
+
+    return perform_clang_import(compiler, c_path, string_to_compile, &unsaved_file, target_scope);
+}
@@ -3,4 +3,9 @@
 #include "ast.h"
 
 bool perform_clang_import(Compiler *compiler, char *c_filepath, Ast_Scope *target_scope);
+void shutdown_clang_import(Compiler *compiler);
+
+// Converts the C declarations named _name_ that were imported into _scope_ to AST, if that has not happened yet.
+void materialize_clang_declarations(Compiler *compiler, Ast_Scope *scope, Atom *name);
+
 bool perform_clang_import_string(Compiler *, String string_to_compile, Ast_Scope *target_scope);
\ No newline at end of file
@@ -43,25 +43,6 @@ String mprintf(char *c_fmt, ...) {
     return builder.to_string();
 }
 
-static
-bool write_entire_file(String filepath, String data) {
-    char *cpath = to_c_string(filepath);
-    defer { free(cpath); };
-
-    FILE *file = fopen(cpath, "wb");
-    if (!file) {
-        return false;
-    }
-    defer { fclose(file); };
-
-    // @Incomplete handle erros and ensure entire string is written
-    auto bytes_written = fwrite(data.data, 1, data.length, file);
-    if (bytes_written != (size_t)data.length) {
-        return false;
-    }
-    return true;
-}
-
 bool types_match(Ast_Type_Info *left, Ast_Type_Info *right) {
     left  = get_final_type(left);
     right = get_final_type(right);
@@ -91,6 +72,11 @@ bool types_match(Ast_Type_Info *left, Ast_Type_Info *right) {
             left->is_dynamic == right->is_dynamic;
     }
 
+    if (left->type == Ast_Type_Info::VECTOR) {
+        return types_match(left->array_element, right->array_element) &&
+            left->array_element_count == right->array_element_count;
+    }
+
     if (left->type == Ast_Type_Info::STRUCT) {
         if (left->is_tuple) {
             if (left->struct_members.count != right->struct_members.count) return false;
@@ -184,6 +170,30 @@ Ast_Type_Info *Compiler::make_array_type(Ast_Type_Info *element, array_count_typ
     return info;
 }
 
+Ast_Type_Info *Compiler::make_vector_type(Ast_Type_Info *element, array_count_type count) {
+    assert(count > 0);
+
+    Ast_Type_Info *info = COMPILER_NEW(Ast_Type_Info);
+    info->type = Ast_Type_Info::VECTOR;
+    info->array_element       = element;
+    info->array_element_count = count;
+
+    // Match LLVM's layout of <N x T>: naturally aligned to the next power of two of the
+    // total size, so vec(float, 3) occupies 16 bytes just like vec(float, 4).
+    auto element_final_type = get_final_type(element);
+    s64 packed_size = element_final_type->size * count;
+
+    s64 alignment = 1;
+    while (alignment < packed_size) alignment *= 2;
+
+    info->alignment = alignment;
+    info->size      = alignment;
+    info->stride    = info->size;
+
+    add_to_type_table(info);
+    return info;
+}
+
 Ast_Type_Info *Compiler::make_pointer_type(Ast_Type_Info *pointee) {
     Ast_Type_Info *info = COMPILER_NEW(Ast_Type_Info);
     info->type = Ast_Type_Info::POINTER;
@@ -408,13 +418,16 @@ void Compiler::init() {
     atom_it        = make_atom(to_string("it"));
     atom_it_index  = make_atom(to_string("it_index"));
     atom_main      = make_atom(to_string("main"));
-    atom___strings_match = make_atom(to_string("__strings_match"));
     atom_os        = make_atom(to_string("os"));
     atom_MacOSX    = make_atom(to_string("MacOSX"));
     atom_Windows   = make_atom(to_string("Windows"));
     atom_Linux     = make_atom(to_string("Linux"));
 
-    atom_builtin_debugtrap = make_atom(BUILTIN_DEBUGTRAP_NAME);
+    atom_builtin_shuffle    = make_atom(to_string("__builtin_shuffle"));
+    atom_builtin_reduce_add = make_atom(to_string("__builtin_reduce_add"));
+    atom_builtin_reduce_mul = make_atom(to_string("__builtin_reduce_mul"));
+    atom_builtin_reduce_min = make_atom(to_string("__builtin_reduce_min"));
+    atom_builtin_reduce_max = make_atom(to_string("__builtin_reduce_max"));
 }
 
 void Compiler::add_to_type_table(Ast_Type_Info *info) {
@@ -618,25 +631,28 @@ void Compiler::resolve_directives() {
 
             directive_queue.ordered_remove(0);
         } else if (directive->type == AST_DIRECTIVE_CLANG_IMPORT) {
-            auto import = static_cast<Ast_Directive_Clang_Import *>(directive);
-
-            // sigh, for some reason, you cannot just pass a string to clang and get
-            // an AST back. The code has to exist in a file at some point.
+            auto target_scope = directive->scope_i_belong_to;
 
-            String path = mprintf(".w%d_temp_c_file.c", this->instance_number);
+            // Batch the run of consecutive #clang_imports of this scope into one translation unit
+            // so headers they share are only parsed once. Stopping at any other directive keeps
+            // the queue order, since an #import or #load may come before a later #clang_import.
+            String_Builder builder;
+            while (directive_queue.count) {
+                auto it = directive_queue[0];
+                if (it->type != AST_DIRECTIVE_CLANG_IMPORT || it->scope_i_belong_to != target_scope) break;
 
-            bool write_entire_file(String filepath, String data);
-            write_entire_file(path, import->string_to_compile);
+                auto import = static_cast<Ast_Directive_Clang_Import *>(it);
+                builder.append(import->string_to_compile);
+                builder.putchar('\n');
 
-            char *c_path = to_c_string(path);
-            perform_clang_import(this, c_path, import->scope_i_belong_to);
+                directive_queue.ordered_remove(0);
+            }
 
-            free(c_path);
-            free(path.data);
+            String source = builder.to_string();
+            perform_clang_import_string(this, source, target_scope);
+            free(source.data);
 
             if (this->errors_reported) return;
-
-            directive_queue.ordered_remove(0);
         } else {
             assert(false);
         }
@@ -904,6 +920,19 @@ Ast_Expression *cast_ptr_to_ptr(Compiler *compiler, Ast_Expression *expr, Ast_Ty
     return cast;
 }
 
+Ast_Expression *cast_scalar_to_vector(Compiler *compiler, Ast_Expression *expr, Ast_Type_Info *target) {
+    while (expr->substitution) expr = expr->substitution;
+
+    assert(is_vector_type(target));
+    assert(types_match(expr->type_info, get_underlying_final_type(target)->array_element));
+
+    Ast_Cast *cast = COMPILER_NEW2(Ast_Cast);
+    copy_location_info(cast, expr);
+    cast->expression = expr;
+    cast->type_info = target;
+    return cast;
+}
+
 Ast_Literal *make_string_literal(Compiler *compiler, String value, Ast *source_loc) {
     Ast_Literal *lit = COMPILER_NEW2(Ast_Literal);
     lit->literal_type = Ast_Literal::STRING;
@@ -18,7 +18,6 @@ struct Copier;
 
 const String OPERATOR_BRACKET_NAME        = to_string("__operator[]");
 const String OPERATOR_BRACKET_EQUALS_NAME = to_string("__operator[]=");
-const String BUILTIN_DEBUGTRAP_NAME      = to_string("__builtin_debugtrap");
 
 struct Atom {
     String name;
@@ -75,6 +74,9 @@ struct Compiler {
     LLVM_Generator *llvm_gen;
     LLVM_Jitter    *jitter;
 
+    void *clang_index = nullptr; // CXIndex, created on the first clang import.
+    Array<Clang_Lazy_Import *> clang_lazy_imports;
+
     Atom_Table *atom_table;
 
     Ast_Scope *preload_scope;
@@ -114,13 +116,16 @@ struct Compiler {
     Atom *atom_it;
     Atom *atom_it_index;
     Atom *atom_main;
-    Atom *atom___strings_match;
     Atom *atom_os;
     Atom *atom_MacOSX;
     Atom *atom_Windows;
     Atom *atom_Linux;
 
-    Atom *atom_builtin_debugtrap;
+    Atom *atom_builtin_shuffle;
+    Atom *atom_builtin_reduce_add;
+    Atom *atom_builtin_reduce_mul;
+    Atom *atom_builtin_reduce_min;
+    Atom *atom_builtin_reduce_max;
 
     Array<Ast_Function    *> function_emission_queue;
     Array<Ast_Declaration *> global_decl_emission_queue;
@@ -148,6 +153,7 @@ struct Compiler {
     Ast_Type_Info *make_pointer_type(Ast_Type_Info *pointee);
     Ast_Type_Info *make_type_alias_type(Ast_Type_Info *aliasee);
     Ast_Type_Info *make_array_type(Ast_Type_Info *element, array_count_type count, bool is_dynamic);
+    Ast_Type_Info *make_vector_type(Ast_Type_Info *element, array_count_type count);
     Ast_Type_Info *make_function_type(Ast_Function *function);
     Ast_Type_Info *make_enum_type(Ast_Enum *_enum);
     void add_to_type_table(Ast_Type_Info *info);
@@ -228,6 +234,19 @@ bool is_array_type(Ast_Type_Info *info) {
     return info->type == Ast_Type_Info::ARRAY;
 }
 
+inline
+bool is_vector_type(Ast_Type_Info *info) {
+    info = get_underlying_final_type(info);
+    return info->type == Ast_Type_Info::VECTOR;
+}
+
+// Operators on vectors apply element-wise, so this is the type operator checks and codegen dispatch on.
+inline
+Ast_Type_Info *get_scalar_type(Ast_Type_Info *info) {
+    if (is_vector_type(info)) return get_underlying_final_type(info)->array_element;
+    return info;
+}
+
 inline
 bool is_aggregate_type(Ast_Type_Info *info) {
     info = get_underlying_final_type(info);
@@ -292,6 +311,17 @@ bool is_valid_primitive_cast(Ast_Type_Info *target, Ast_Type_Info *source) {
         return (source->type == Ast_Type_Info::INTEGER) || (source->type == Ast_Type_Info::ENUM);
     }
 
+    if (target->type == Ast_Type_Info::VECTOR) {
+        // Element-wise conversion between vectors of the same width, or a splat of a scalar into every lane.
+        if (source->type == Ast_Type_Info::VECTOR) {
+            if (source->array_element_count != target->array_element_count) return false;
+            return is_valid_primitive_cast(target->array_element, source->array_element);
+        }
+
+        return (source->type == Ast_Type_Info::INTEGER || source->type == Ast_Type_Info::FLOAT) &&
+            is_valid_primitive_cast(target->array_element, source);
+    }
+
     return false;
 }
 
@@ -343,6 +373,9 @@ Ast_Expression *cast_int_to_float(Compiler *compiler, Ast_Expression *expr, Ast_
 
 Ast_Expression *cast_ptr_to_ptr(Compiler *compiler, Ast_Expression *expr, Ast_Type_Info *target);
 
+// _expr_ must already be of the vector's element type.
+Ast_Expression *cast_scalar_to_vector(Compiler *compiler, Ast_Expression *expr, Ast_Type_Info *target);
+
 Ast_Literal *make_string_literal(Compiler *compiler, String value, Ast *source_loc = nullptr);
 
 Ast_Literal *make_integer_literal(Compiler *compiler, s64 value, Ast_Type_Info *type_info, Ast *source_loc = nullptr);
@@ -16,6 +16,7 @@
 
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/ADT/Triple.h"
+#include "llvm/BinaryFormat/Magic.h"
 
 #ifdef WIN32
 #pragma warning(pop)
@@ -130,22 +131,109 @@ u8 *get_command_line(Array<String> *strings) {
 static
 const char *preload_text = R"C01N(
 
-func __strings_match(a: string, b: string) -> bool {
-    if (a.length != b.length) return false;
-    if (a.data == null && b.data == null) return true;
+)C01N";
+
+struct Intrinsic_Info {
+    Intrinsic_Kind kind;
+    const char *name;
+    const char *signature;
+};
+
+// Functions that are lowered straight to LLVM intrinsics instead of calls, see LLVM_Generator::emit_intrinsic_call.
+// A signature using a $ placeholder is declared once for each type in the placeholder's class:
+// $I every integer type, $W integers of 16 bits or more, $F float and double scalars and vectors,
+// $S everything in $I and $F.
+static
+const Intrinsic_Info intrinsic_table[] = {
+    { INTRINSIC_DEBUGTRAP,         "__builtin_debugtrap",         "()" },
+    { INTRINSIC_CTPOP,             "__builtin_ctpop",             "(x: $I) -> $I" },
+    { INTRINSIC_CTLZ,              "__builtin_ctlz",              "(x: $I) -> $I" },
+    { INTRINSIC_CTTZ,              "__builtin_cttz",              "(x: $I) -> $I" },
+    { INTRINSIC_BSWAP,             "__builtin_bswap",             "(x: $W) -> $W" },
+    { INTRINSIC_FMA,               "__builtin_fma",               "(a: $F, b: $F, c: $F) -> $F" },
+    { INTRINSIC_SQRT,              "__builtin_sqrt",              "(x: $F) -> $F" },
+    { INTRINSIC_RSQRT,             "__builtin_rsqrt",             "(x: $F) -> $F" },
+    { INTRINSIC_PREFETCH,          "__builtin_prefetch",          "(address: *void, write: bool = false, locality: int32 = 3)" },
+    { INTRINSIC_EXPECT,            "__builtin_expect",            "(value: bool, expected: bool) -> bool" },
+    { INTRINSIC_EXPECT,            "__builtin_expect",            "(value: $I, expected: $I) -> $I" },
+    { INTRINSIC_ASSUME,            "__builtin_assume",            "(condition: bool)" },
+    { INTRINSIC_NONTEMPORAL_STORE, "__builtin_nontemporal_store", "(address: *$S, value: $S)" },
+    { INTRINSIC_READCYCLECOUNTER,  "__builtin_readcyclecounter",  "() -> uint64" },
+};
 
-    if (a.data == null) return false;
-    if (b.data == null) return false;
+static
+const char *intrinsic_integer_types[] = { "int8", "uint8", "int16", "uint16", "int32", "uint32", "int64", "uint64" };
+
+static
+const char *intrinsic_float_types[] = { "float", "double", "vec(float, 4)", "vec(float, 8)", "vec(double, 2)", "vec(double, 4)" };
 
+static
+void append_intrinsic_declaration(String_Builder *builder, const Intrinsic_Info *info, const char *type_name) {
+    builder->print("func %s", info->name);
 
-    for 0..<a.length {
-        if (a[it] != b[it]) return false;
+    for (const char *c = info->signature; *c; ++c) {
+        if (*c == '$') {
+            builder->append((char *)type_name);
+            ++c; // Skip the class letter.
+        } else {
+            builder->putchar(*c);
+        }
     }
 
-    return true;
+    builder->append(";\n");
 }
 
-)C01N";
+// Declares the intrinsics from intrinsic_table in the preload scope.
+static
+void load_intrinsic_declarations(Compiler *compiler) {
+    String_Builder builder;
+
+    for (auto &info : intrinsic_table) {
+        auto placeholder = strchr(info.signature, '$');
+        if (!placeholder) {
+            append_intrinsic_declaration(&builder, &info, nullptr);
+            continue;
+        }
+
+        char type_class = placeholder[1];
+        if (type_class == 'I' || type_class == 'W' || type_class == 'S') {
+            for (auto type_name : intrinsic_integer_types) {
+                bool is_8_bit = (strcmp(type_name, "int8") == 0 || strcmp(type_name, "uint8") == 0);
+                if (type_class == 'W' && is_8_bit) continue;
+
+                append_intrinsic_declaration(&builder, &info, type_name);
+            }
+        }
+
+        if (type_class == 'F' || type_class == 'S') {
+            for (auto type_name : intrinsic_float_types) {
+                append_intrinsic_declaration(&builder, &info, type_name);
+            }
+        }
+    }
+
+    auto first_declaration = compiler->preload_scope->declarations.count;
+
+    // The tokens point into the source text, so it is kept around for the lifetime of the compiler.
+    perform_load_from_string(compiler, builder.to_string(), compiler->preload_scope);
+
+    for (auto i = first_declaration; i < compiler->preload_scope->declarations.count; ++i) {
+        auto decl = compiler->preload_scope->declarations[i];
+        if (decl->type != AST_FUNCTION) continue;
+
+        auto function = static_cast<Ast_Function *>(decl);
+        String name = function->identifier->name->name;
+
+        for (auto &info : intrinsic_table) {
+            if (name == to_string(info.name)) {
+                function->intrinsic_kind = info.kind;
+                break;
+            }
+        }
+
+        assert(function->intrinsic_kind != INTRINSIC_NONE);
+    }
+}
 
 extern "C" {
     EXPORT String compiler_system_get_default_module_search_path() {
@@ -173,6 +261,35 @@ extern "C" {
         compiler->build_options.only_want_obj_file  = options->only_want_obj_file;
         compiler->build_options.verbose_diagnostics = options->verbose_diagnostics;
         compiler->build_options.emit_llvm_ir        = options->emit_llvm_ir;
+        compiler->build_options.optimization_level  = options->optimization_level;
+        compiler->build_options.optimize_for_size   = options->optimize_for_size;
+        compiler->build_options.fast_debug          = options->fast_debug;
+        compiler->build_options.lto_mode            = options->lto_mode;
+        compiler->build_options.jit_optimization_level = options->jit_optimization_level;
+        compiler->build_options.debug_info_level    = options->debug_info_level;
+        compiler->build_options.split_debug_info    = options->split_debug_info;
+        compiler->build_options.bounds_check        = options->bounds_check;
+
+        if (compiler->build_options.optimize_for_size) compiler->build_options.optimization_level = 2;
+        if (compiler->build_options.fast_debug) {
+            compiler->build_options.optimization_level = 0;
+            compiler->build_options.optimize_for_size  = false;
+        }
+        if (compiler->build_options.optimization_level < 0) compiler->build_options.optimization_level = 0;
+        if (compiler->build_options.optimization_level > 3) compiler->build_options.optimization_level = 3;
+        if (compiler->build_options.jit_optimization_level < 0) compiler->build_options.jit_optimization_level = 0;
+        if (compiler->build_options.jit_optimization_level > 3) compiler->build_options.jit_optimization_level = 3;
+        if (compiler->build_options.debug_info_level < DEBUG_INFO_NONE) compiler->build_options.debug_info_level = DEBUG_INFO_NONE;
+        if (compiler->build_options.debug_info_level > DEBUG_INFO_FULL) compiler->build_options.debug_info_level = DEBUG_INFO_FULL;
+
+        compiler->build_options.cpu_name     = copy_string(options->cpu_name);
+        compiler->build_options.cpu_features = copy_string(options->cpu_features);
+
+        if (options->cache_directory != String()) {
+            compiler->build_options.cache_directory = copy_string(options->cache_directory);
+        } else {
+            compiler->build_options.cache_directory = to_string(".jiyu_cache");
+        }
 
         compiler->llvm_gen = new LLVM_Generator(compiler);
         compiler->llvm_gen->preinit();
@@ -207,20 +324,15 @@ extern "C" {
             compiler->preload_scope->declarations.add(alias);
         }
 
-        // Insert intrinsic functions
-        {
-            Ast_Identifier *ident = make_identifier(compiler, compiler->atom_builtin_debugtrap);
-            auto debug_trap = make_function(compiler, ident);
-            debug_trap->is_intrinsic = true;
-            compiler->preload_scope->statements.add(debug_trap);
-            compiler->preload_scope->declarations.add(debug_trap);
-        }
+        load_intrinsic_declarations(compiler);
 
         os_init(compiler);
         return compiler;
     }
 
     EXPORT void destroy_compiler_instance(Compiler *compiler) {
+        shutdown_clang_import(compiler);
+
         delete compiler->sema;
         delete compiler->copier;
         delete compiler->llvm_gen;
@@ -229,6 +341,21 @@ extern "C" {
         delete compiler;
     }
 
+    // Objects we link need an LTO-capable linker if we emitted bitcode, or if the user supplied
+    // bitcode objects, such as ones built with clang -flto.
+    static bool link_needs_lto(Compiler *compiler) {
+        if (compiler->build_options.lto_mode != LTO_NONE) return true;
+
+        for (auto obj: compiler->user_supplied_objs) {
+            llvm::file_magic magic;
+            if (llvm::identify_magic(llvm::StringRef(obj.data, obj.length), magic)) continue;
+
+            if (magic == llvm::file_magic::bitcode) return true;
+        }
+
+        return false;
+    }
+
     EXPORT bool compiler_run_default_link_command(Compiler *compiler) {
         MICROPROFILE_SCOPEI("compiler", "compiler_run_default_link_command", -1);
 
@@ -246,8 +373,15 @@ extern "C" {
 
             Array<String> args;
 
-            snprintf(exe_path, LINE_SIZE, "%S\\link.exe", win32_sdk.vs_exe_path);
-            args.add(to_string(exe_path));
+            bool use_lto = link_needs_lto(compiler);
+            if (use_lto) {
+                // link.exe cannot read LLVM bitcode, lld-link is expected to be in PATH.
+                args.add(to_string("lld-link.exe"));
+                args.add(mprintf("/opt:lldlto=%d", compiler->build_options.optimization_level)); // @Leak
+            } else {
+                snprintf(exe_path, LINE_SIZE, "%S\\link.exe", win32_sdk.vs_exe_path);
+                args.add(to_string(exe_path));
+            }
 
             if (win32_sdk.vs_library_path) {
 
@@ -330,7 +464,21 @@ extern "C" {
 #else
         // @Incomplete should use the execpve family
         Array<String> args;
-        args.add(to_string("ld"));
+
+        auto triple = compiler->llvm_gen->TargetMachine->getTargetTriple();
+
+        // The system linker on Darwin reads bitcode through libLTO, elsewhere we use lld.
+        bool use_lto = link_needs_lto(compiler);
+        if (use_lto && !triple.isOSDarwin()) {
+            args.add(to_string("ld.lld"));
+            args.add(mprintf("--lto-O%d", compiler->build_options.optimization_level)); // @Leak
+
+            if (compiler->build_options.lto_mode == LTO_THIN) {
+                args.add(mprintf("--thinlto-cache-dir=%.*s/thinlto", PRINT_ARG(compiler->build_options.cache_directory))); // @Leak
+            }
+        } else {
+            args.add(to_string("ld"));
+        }
 
         String exec_name = compiler->build_options.executable_name;
         String obj_name = mprintf("%.*s.o", exec_name.length, exec_name.data);
@@ -341,7 +489,6 @@ extern "C" {
             args.add(obj);
         }
 
-        auto triple = compiler->llvm_gen->TargetMachine->getTargetTriple();
         if (triple.isOSLinux()) {
             // CRT files
             // these seem to be GCC specific
@@ -522,6 +669,10 @@ extern "C" {
         return compiler->jitter->lookup_symbol(symbol_name);
     }
 
+    EXPORT bool compiler_jit_lookup_symbols(Compiler *compiler, String *symbol_names, void **out_symbols, s64 count) {
+        return compiler->jitter->lookup_symbols(symbol_names, out_symbols, count);
+    }
+
     EXPORT void compiler_add_library_search_path(Compiler *compiler, String path) {
         compiler->library_search_paths.add(copy_string(path)); // @Leak @Deduplicate
     }
@@ -10,6 +10,16 @@
 
 struct Compiler;
 
+// @Volatile must match Compiler.jyu stuff
+const s32 LTO_NONE = 0;
+const s32 LTO_FULL = 1;
+const s32 LTO_THIN = 2;
+
+// @Volatile must match Compiler.jyu stuff
+const s32 DEBUG_INFO_NONE        = 0;
+const s32 DEBUG_INFO_LINE_TABLES = 1;
+const s32 DEBUG_INFO_FULL        = 2;
+
 // @Volatile must match Compiler.jyu stuff
 struct Build_Options {
     String executable_name;
@@ -17,6 +27,44 @@ struct Build_Options {
     bool only_want_obj_file  = false;
     bool verbose_diagnostics = false;
     bool emit_llvm_ir = false;
+
+    // 0 through 3, like -O0 through -O3. optimize_for_size selects the -Os pipeline instead and
+    // is treated as level 2 for code generation.
+    s32  optimization_level = 0;
+    bool optimize_for_size  = false;
+
+    // Favor compile time over code quality: only run mem2reg, use the fast instruction
+    // selector and skip IR verification in release builds of the compiler. Implies level 0.
+    bool fast_debug = false;
+
+    // One of the LTO_ constants. With LTO, the object file contains LLVM bitcode and the
+    // default link command uses an LTO-capable linker.
+    s32 lto_mode = LTO_NONE;
+
+    // 0 through 3, optimization level for code compiled by the JIT, such as metaprograms.
+    // Higher levels make long-running metaprograms faster at the cost of startup time.
+    s32 jit_optimization_level = 0;
+
+    // One of the DEBUG_INFO_ constants, as in -g0, -gline-tables-only and -g. Line tables are
+    // enough for stack traces and profilers, full debug info also describes types and variables.
+    s32 debug_info_level = DEBUG_INFO_FULL;
+    // Write most of the DWARF to a .dwo file next to the object file instead of the object
+    // file itself, so the linker has less to process. Only supported for ELF targets.
+    bool split_debug_info = false;
+
+    // Check the index of every [] on arrays and strings, and trap if it is out of range.
+    bool bounds_check = false;
+
+    // CPU to generate code for, as in -mcpu. If left empty, "generic" is used for
+    // object files and the host CPU is used for JIT programs. "native" selects the host
+    // CPU and all of its features.
+    String cpu_name;
+    // Comma separated LLVM feature list, as in -mattr, such as "+avx2,-fma".
+    String cpu_features;
+
+    // Directory used for cached build artifacts, such as precompiled C headers.
+    // If left empty, .jiyu_cache in the working directory is used.
+    String cache_directory;
 };
 
 #ifdef __cplusplus
@@ -36,6 +84,9 @@ extern "C" {
     EXPORT bool compiler_emit_object_file(Compiler *compiler);
     EXPORT bool compiler_jit_program(Compiler *compiler);
     EXPORT void *compiler_jit_lookup_symbol(Compiler *compiler, String symbol_name);
+    // Looks up _count_ symbols at once, which is much faster than calling compiler_jit_lookup_symbol
+    // for each one. _out_symbols_ receives null for missing symbols, returns true if all were found.
+    EXPORT bool  compiler_jit_lookup_symbols(Compiler *compiler, String *symbol_names, void **out_symbols, s64 count);
     EXPORT void compiler_add_library_search_path(Compiler *compiler, String path);
     EXPORT void compiler_add_module_search_path(Compiler *compiler, String path);
     EXPORT void compiler_add_compiled_object_for_linking(Compiler *compiler, String path);
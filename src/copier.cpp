@@ -73,7 +73,11 @@ Ast_Function *Copier::copy_function(Ast_Function *old) {
     COPY_P(is_template_function);
     COPY_P(linkage_name);
     COPY_P(is_operator_function);
-    COPY_P(is_intrinsic);
+    COPY_P(intrinsic_kind);
+    COPY_P(is_marked_inline);
+    COPY_P(is_marked_noinline);
+    COPY_P(is_marked_cold);
+    COPY_P(is_marked_hot);
     COPY_P(operator_type);
 
 
@@ -205,6 +209,7 @@ Ast_Expression *Copier::copy(Ast_Expression *expression) {
             auto _new = COPIER_NEW(Ast_While);
 
             COPY(condition);
+            COPY_P(hints);
 
             copy_scope(&_new->body, &old->body);
             _new->body.owning_statement = _new;
@@ -228,6 +233,8 @@ Ast_Expression *Copier::copy(Ast_Expression *expression) {
             COPY(array_element_type);
             COPY(array_size_expression);
             COPY_P(array_is_dynamic);
+            COPY(vector_element_type);
+            COPY(vector_width_expression);
             COPY(function_header);
             COPY(template_type_inst_of);
             COPY_ARRAY(template_type_arguments);
@@ -285,6 +292,7 @@ Ast_Expression *Copier::copy(Ast_Expression *expression) {
 
             COPY_P(is_element_pointer_iteration);
             COPY_P(is_exclusive_end);
+            COPY_P(hints);
             COPY(iterator_decl);
             COPY(iterator_index_decl);
             COPY(initial_iterator_expression);
@@ -403,6 +411,17 @@ Ast_Expression *Copier::copy(Ast_Expression *expression) {
             return _new;
         }
 
+        case AST_VECTOR_BUILTIN: {
+            auto old  = static_cast<Ast_Vector_Builtin *>(expression);
+            auto _new = COPIER_NEW(Ast_Vector_Builtin);
+
+            COPY_P(builtin_kind);
+            COPY_ARRAY(arguments);
+            COPY_ARRAY_P(shuffle_mask);
+
+            return _new;
+        }
+
         case AST_UNINITIALIZED:
         default:
             assert(false);
@@ -588,6 +607,15 @@ bool Copier::try_to_fill_polymorphic_type_aliases(Ast_Type_Instantiation *type_i
         return success;
     }
 
+    if (type_inst->vector_element_type) {
+        if (target_type_info->type != Ast_Type_Info::VECTOR) return false;
+
+        bool success = try_to_fill_polymorphic_type_aliases(type_inst->vector_element_type, target_type_info->array_element, false);
+        if (compiler->errors_reported) return false;
+
+        return success;
+    }
+
     if (type_inst->template_type_inst_of) {
         if (target_type_info->type != Ast_Type_Info::STRUCT) return false;
 
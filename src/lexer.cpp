@@ -349,6 +349,10 @@ Token Lexer::lex_token() {
         else if (result.string == to_string("@export"))      result.type = Token::TAG_EXPORT;
         else if (result.string == to_string("@flags"))       result.type = Token::TAG_FLAGS;
         else if (result.string == to_string("@distinct"))    result.type = Token::TAG_DISTINCT;
+        else if (result.string == to_string("@inline"))      result.type = Token::TAG_INLINE;
+        else if (result.string == to_string("@noinline"))    result.type = Token::TAG_NOINLINE;
+        else if (result.string == to_string("@cold"))        result.type = Token::TAG_COLD;
+        else if (result.string == to_string("@hot"))         result.type = Token::TAG_HOT;
 
         else if (result.string == to_string("temporary_c_vararg")) result.type = Token::TEMPORARY_KEYWORD_C_VARARGS;
 
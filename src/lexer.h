@@ -94,6 +94,10 @@ struct Token {
         TAG_EXPORT,
         TAG_FLAGS,
         TAG_DISTINCT,
+        TAG_INLINE,
+        TAG_NOINLINE,
+        TAG_COLD,
+        TAG_HOT,
 
         TEMPORARY_KEYWORD_C_VARARGS = 400,
 
@@ -29,12 +29,19 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Host.h"
+#include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
@@ -44,17 +51,25 @@
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/IRBuilder.h"
 
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
 #include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
 #include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
 
 #include "llvm/Transforms/Utils/Cloning.h"
 
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Transforms/Utils.h"
 
 #ifdef WIN32
@@ -80,6 +95,48 @@ string_length_type get_line_number(Ast *ast) {
     return line_start;
 }
 
+// Resolves Build_Options::cpu_name and cpu_features to what LLVM expects. _default_to_host_
+// is set when the code will run on this machine, such as for the JIT.
+static void get_target_cpu(Build_Options *options, bool default_to_host, std::string *cpu, std::string *features) {
+    SubtargetFeatures feature_list;
+
+    if (options->cpu_name == to_string("native") || (default_to_host && options->cpu_name == String())) {
+        *cpu = sys::getHostCPUName().str();
+
+        StringMap<bool> host_features;
+        if (sys::getHostCPUFeatures(host_features)) {
+            for (auto &feature : host_features) {
+                feature_list.AddFeature(feature.first(), feature.second);
+            }
+        }
+    } else if (options->cpu_name == String()) {
+        *cpu = "generic";
+    } else {
+        *cpu = std::string(options->cpu_name.data, options->cpu_name.length);
+    }
+
+    // Explicit features come last so they override the host's.
+    *features = feature_list.getString();
+    if (options->cpu_features != String()) {
+        if (!features->empty()) *features += ",";
+        *features += std::string(options->cpu_features.data, options->cpu_features.length);
+    }
+}
+
+// Split DWARF needs a skeleton compile unit in the object file that points at the .dwo file,
+// which we only support for ELF. LTO objects contain bitcode, so there is nothing to split there.
+static bool wants_split_debug_info(Build_Options *options, const Triple &triple) {
+    if (!options->split_debug_info) return false;
+    if (options->debug_info_level == DEBUG_INFO_NONE) return false;
+    if (options->lto_mode != LTO_NONE) return false;
+
+    return triple.isOSBinFormatELF();
+}
+
+static String get_split_dwarf_name(Build_Options *options) {
+    return mprintf("%.*s.dwo", PRINT_ARG(options->executable_name));
+}
+
 void LLVM_Generator::preinit() {
     // This gets called before Compiler is fully initialized so that Compiler
     // can query TargetMachine to configure string and arrays to be the right
@@ -120,13 +177,39 @@ void LLVM_Generator::preinit() {
         return;
     }
 
-    auto CPU = "generic";
-    auto Features = "";
+    std::string CPU;
+    std::string Features;
+    get_target_cpu(&compiler->build_options, /*default_to_host=*/false, &CPU, &Features);
+
+    if (compiler->build_options.verbose_diagnostics) {
+        printf("w%" PRId64 ": LLVM target CPU: %s\n",          compiler->instance_number, CPU.c_str());
+        printf("w%" PRId64 ": LLVM target features: %s\n",     compiler->instance_number, Features.c_str());
+    }
+
+    CodeGenOpt::Level codegen_level = CodeGenOpt::None;
+    switch (compiler->build_options.optimization_level) {
+        case 0: codegen_level = CodeGenOpt::None;       break;
+        case 1: codegen_level = CodeGenOpt::Less;       break;
+        case 2: codegen_level = CodeGenOpt::Default;    break;
+        case 3: codegen_level = CodeGenOpt::Aggressive; break;
+    }
 
     TargetOptions opt;
+    if (wants_split_debug_info(&compiler->build_options, Triple(TargetTriple))) {
+        String dwo_name = get_split_dwarf_name(&compiler->build_options);
+        opt.MCOptions.SplitDwarfFile = string_ref(dwo_name).str();
+        free(dwo_name.data);
+    }
+
     auto RM = Optional<Reloc::Model>();
     // RM = Reloc::Model::PIC_;
-    TargetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
+    TargetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM, None, codegen_level);
+
+    if (compiler->build_options.fast_debug) {
+        // FastISel falls back to SelectionDAG per instruction for anything it cannot handle,
+        // so this is always safe to request.
+        TargetMachine->setFastISel(true);
+    }
 }
 
 void LLVM_Generator::init() {
@@ -137,13 +220,26 @@ void LLVM_Generator::init() {
     llvm_module = new Module("jiyu Module", *llvm_context);
 
     irb = new IRBuilder<>(*llvm_context);
-    dib = new DIBuilder(*llvm_module);
 
-    const char *JIYU_PRODUCER_STRING = "Jiyu Compiler";
-    bool is_optimized = false; // @BuildOptions
-    const char *COMMAND_LINE_FLAGS = "";
-    const unsigned runtime_version = 0;
-    di_compile_unit = dib->createCompileUnit(dwarf::DW_LANG_C, DIFile::get(*llvm_context, "fib.jyu", "."), JIYU_PRODUCER_STRING, is_optimized, COMMAND_LINE_FLAGS, runtime_version);
+    // At -g0, dib and di_current_scope stay null. DebugLoc::get() returns an unknown location
+    // for a null scope, so code generation doesn't have to check for that everywhere.
+    dib = nullptr;
+    di_compile_unit = nullptr;
+    if (compiler->build_options.debug_info_level != DEBUG_INFO_NONE) {
+        dib = new DIBuilder(*llvm_module);
+
+        const char *JIYU_PRODUCER_STRING = "Jiyu Compiler";
+        bool is_optimized = compiler->build_options.optimization_level > 0;
+        const char *COMMAND_LINE_FLAGS = "";
+        const unsigned runtime_version = 0;
+
+        auto emission_kind = DICompileUnit::FullDebug;
+        if (compiler->build_options.debug_info_level == DEBUG_INFO_LINE_TABLES) emission_kind = DICompileUnit::LineTablesOnly;
+
+        // With split DWARF, the .dwo name comes from TargetOptions::MCOptions instead, see preinit().
+        di_compile_unit = dib->createCompileUnit(dwarf::DW_LANG_C, DIFile::get(*llvm_context, "fib.jyu", "."), JIYU_PRODUCER_STRING, is_optimized, COMMAND_LINE_FLAGS, runtime_version,
+                                                 /*SplitName=*/"", emission_kind);
+    }
 
     type_void = Type::getVoidTy(*llvm_context);
     type_i1   = Type::getInt1Ty(*llvm_context);
@@ -170,57 +266,60 @@ void LLVM_Generator::init() {
     // Matches the definition in general.h, except when the target's pointer size doesn't match the host's.
     type_string = StructType::create(*llvm_context, { type_i8->getPointerTo(), type_string_length }, "string", false/*packed*/);
 
-    di_type_bool = dib->createBasicType("bool",    8, dwarf::DW_ATE_boolean);
-    di_type_s8   = dib->createBasicType("int8",    8, dwarf::DW_ATE_signed);
-    di_type_s16  = dib->createBasicType("int16",  16, dwarf::DW_ATE_signed);
-    di_type_s32  = dib->createBasicType("int32",  32, dwarf::DW_ATE_signed);
-    di_type_s64  = dib->createBasicType("int64",  64, dwarf::DW_ATE_signed);
-    di_type_u8   = dib->createBasicType("uint8",   8, dwarf::DW_ATE_unsigned);
-    di_type_u16  = dib->createBasicType("uint16", 16, dwarf::DW_ATE_unsigned);
-    di_type_u32  = dib->createBasicType("uint32", 32, dwarf::DW_ATE_unsigned);
-    di_type_u64  = dib->createBasicType("uint64", 64, dwarf::DW_ATE_unsigned);
-    di_type_f32  = dib->createBasicType("float",  32, dwarf::DW_ATE_float);
-    di_type_f64  = dib->createBasicType("double", 64, dwarf::DW_ATE_float);
-    di_type_f64  = dib->createBasicType("float128", 128, dwarf::DW_ATE_float);
-
-    di_type_string_length = nullptr;
-    if (TargetMachine->getPointerSize(0) == 4) {
-        di_type_string_length = di_type_s32;
-    } else if (TargetMachine->getPointerSize(0) == 8) {
-        di_type_string_length = di_type_s64;
-    }
+    // Types are only described by full debug info, line tables don't need any of this.
+    if (compiler->build_options.debug_info_level == DEBUG_INFO_FULL) {
+        di_type_bool = dib->createBasicType("bool",    8, dwarf::DW_ATE_boolean);
+        di_type_s8   = dib->createBasicType("int8",    8, dwarf::DW_ATE_signed);
+        di_type_s16  = dib->createBasicType("int16",  16, dwarf::DW_ATE_signed);
+        di_type_s32  = dib->createBasicType("int32",  32, dwarf::DW_ATE_signed);
+        di_type_s64  = dib->createBasicType("int64",  64, dwarf::DW_ATE_signed);
+        di_type_u8   = dib->createBasicType("uint8",   8, dwarf::DW_ATE_unsigned);
+        di_type_u16  = dib->createBasicType("uint16", 16, dwarf::DW_ATE_unsigned);
+        di_type_u32  = dib->createBasicType("uint32", 32, dwarf::DW_ATE_unsigned);
+        di_type_u64  = dib->createBasicType("uint64", 64, dwarf::DW_ATE_unsigned);
+        di_type_f32  = dib->createBasicType("float",  32, dwarf::DW_ATE_float);
+        di_type_f64  = dib->createBasicType("double", 64, dwarf::DW_ATE_float);
+        di_type_f64  = dib->createBasicType("float128", 128, dwarf::DW_ATE_float);
+
+        di_type_string_length = nullptr;
+        if (TargetMachine->getPointerSize(0) == 4) {
+            di_type_string_length = di_type_s32;
+        } else if (TargetMachine->getPointerSize(0) == 8) {
+            di_type_string_length = di_type_s64;
+        }
 
-    {
-        auto debug_file = DIFile::get(*llvm_context, "", "");
-        unsigned line_number = 0;
-        DINode::DIFlags flags = DINode::DIFlags();
+        {
+            auto debug_file = DIFile::get(*llvm_context, "", "");
+            unsigned line_number = 0;
+            DINode::DIFlags flags = DINode::DIFlags();
 
-        auto di_data_type  = dib->createPointerType(di_type_u8, TargetMachine->getPointerSizeInBits(0));
+            auto di_data_type  = dib->createPointerType(di_type_u8, TargetMachine->getPointerSizeInBits(0));
 
-        // @Cleanup literal numbers
-        auto data = dib->createMemberType(di_compile_unit, "data", debug_file, line_number,
-                            TargetMachine->getPointerSizeInBits(0), TargetMachine->getPointerSizeInBits(0),
-                            0, flags, di_data_type);
-        auto length = dib->createMemberType(di_compile_unit, "length", debug_file, line_number,
-                            type_string_length->getPrimitiveSizeInBits(), type_string_length->getPrimitiveSizeInBits(),
-                            TargetMachine->getPointerSizeInBits(0), flags, di_type_string_length);
-        auto elements = dib->getOrCreateArray({data, length});
+            // @Cleanup literal numbers
+            auto data = dib->createMemberType(di_compile_unit, "data", debug_file, line_number,
+                                TargetMachine->getPointerSizeInBits(0), TargetMachine->getPointerSizeInBits(0),
+                                0, flags, di_data_type);
+            auto length = dib->createMemberType(di_compile_unit, "length", debug_file, line_number,
+                                type_string_length->getPrimitiveSizeInBits(), type_string_length->getPrimitiveSizeInBits(),
+                                TargetMachine->getPointerSizeInBits(0), flags, di_type_string_length);
+            auto elements = dib->getOrCreateArray({data, length});
 
-        auto type = compiler->type_string;
-        di_type_string = dib->createStructType(di_compile_unit, "string", debug_file,
-                            line_number, type->size * BYTES_TO_BITS, type->alignment * BYTES_TO_BITS,
-                            flags, nullptr, elements);
-    }
+            auto type = compiler->type_string;
+            di_type_string = dib->createStructType(di_compile_unit, "string", debug_file,
+                                line_number, type->size * BYTES_TO_BITS, type->alignment * BYTES_TO_BITS,
+                                flags, nullptr, elements);
+        }
 
-    {
-        auto debug_file = DIFile::get(*llvm_context, "", "");
-        unsigned line_number = 0;
-        DINode::DIFlags flags = DINode::DIFlags();
+        {
+            auto debug_file = DIFile::get(*llvm_context, "", "");
+            unsigned line_number = 0;
+            DINode::DIFlags flags = DINode::DIFlags();
 
-        auto info = compiler->type_info_type;
-        auto elements = dib->getOrCreateArray({});
-        di_type_type = dib->createStructType(di_compile_unit, "Type", debug_file, line_number,
-                        info->size * BYTES_TO_BITS, info->alignment * BYTES_TO_BITS, flags, nullptr, elements);
+            auto info = compiler->type_info_type;
+            auto elements = dib->getOrCreateArray({});
+            di_type_type = dib->createStructType(di_compile_unit, "Type", debug_file, line_number,
+                            info->size * BYTES_TO_BITS, info->alignment * BYTES_TO_BITS, flags, nullptr, elements);
+        }
     }
 
     di_current_scope = di_compile_unit;
@@ -241,8 +340,71 @@ void LLVM_Generator::init() {
     // @Incomplete do this for llvm_debug_types as well..
 }
 
+// Runs LLVM's default module pipeline for the optimization level in build_options.
+// This does nothing at -O0, where we only want the module to be emitted as quickly as possible.
+static void optimize_module(Compiler *compiler, TargetMachine *TM, Module *module) {
+    auto options = &compiler->build_options;
+    if (options->optimization_level == 0) return;
+
+    MICROPROFILE_SCOPEI("llvm", "optimize_module", -1);
+
+    PassBuilder::OptimizationLevel level = PassBuilder::OptimizationLevel::O2;
+    if (options->optimize_for_size) {
+        level = PassBuilder::OptimizationLevel::Os;
+    } else if (options->optimization_level == 1) {
+        level = PassBuilder::OptimizationLevel::O1;
+    } else if (options->optimization_level == 3) {
+        level = PassBuilder::OptimizationLevel::O3;
+    }
+
+    PassBuilder pass_builder(TM);
+
+    LoopAnalysisManager     LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager    CGAM;
+    ModuleAnalysisManager   MAM;
+
+    pass_builder.registerModuleAnalyses(MAM);
+    pass_builder.registerCGSCCAnalyses(CGAM);
+    pass_builder.registerFunctionAnalyses(FAM);
+    pass_builder.registerLoopAnalyses(LAM);
+    pass_builder.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    // With LTO, only run the pre-link part of the pipeline here and let the linker do the rest
+    // once it can see the whole program.
+    ModulePassManager MPM;
+    if (options->lto_mode == LTO_FULL) {
+        MPM = pass_builder.buildLTOPreLinkDefaultPipeline(level);
+    } else if (options->lto_mode == LTO_THIN) {
+        MPM = pass_builder.buildThinLTOPreLinkDefaultPipeline(level);
+    } else {
+        MPM = pass_builder.buildPerModuleDefaultPipeline(level);
+    }
+
+    MPM.run(*module, MAM);
+}
+
+// The optimization pipelines inline @inline functions on their own, this makes sure that happens at -O0 too.
+static void inline_always_inline_functions(Module *module) {
+    bool has_always_inline_functions = false;
+    for (auto &func : module->functions()) {
+        if (func.hasFnAttribute(Attribute::AlwaysInline)) {
+            has_always_inline_functions = true;
+            break;
+        }
+    }
+
+    if (!has_always_inline_functions) return;
+
+    MICROPROFILE_SCOPEI("llvm", "always_inline", -1);
+
+    legacy::PassManager pass;
+    pass.add(createAlwaysInlinerLegacyPass());
+    pass.run(*module);
+}
+
 void LLVM_Generator::finalize() {
-    dib->finalize();
+    if (dib) dib->finalize();
 
     std::string TargetTriple = TargetMachine->getTargetTriple().str();
     // printf("TRIPLE: %s\n", TargetTriple.c_str());
@@ -266,18 +428,48 @@ void LLVM_Generator::finalize() {
         return;
     }
 
+    std::unique_ptr<raw_fd_ostream> dwo_dest;
+    if (wants_split_debug_info(&compiler->build_options, TargetMachine->getTargetTriple())) {
+        String dwo_name = get_split_dwarf_name(&compiler->build_options);
+        dwo_dest = llvm::make_unique<raw_fd_ostream>(string_ref(dwo_name), EC, sys::fs::F_None);
+        free(dwo_name.data);
+
+        if (EC) {
+            compiler->report_error((Ast *)nullptr, "Could not open file: %s\n", EC.message().c_str());
+            return;
+        }
+    }
+
     legacy::PassManager pass;
     auto FileType = TargetMachine::CGFT_ObjectFile;
 
-    /*
-    auto fpm = make_unique<legacy::FunctionPassManager>(llvm_module);
-    fpm->add(createPromoteMemoryToRegisterPass());
-    fpm->doInitialization();
+    if (compiler->build_options.optimization_level > 0) {
+        // The optimizer assumes valid IR, so verify the module before handing it over
+        // instead of leaving it to the verifier pass in the codegen pipeline.
+        if (verifyModule(*llvm_module, &errs())) {
+            compiler->report_error((Ast *)nullptr, "LLVM module failed verification. This is a compiler bug.\n");
+            return;
+        }
+
+        optimize_module(compiler, TargetMachine, llvm_module);
+    } else {
+        inline_always_inline_functions(llvm_module);
+
+        if (compiler->build_options.fast_debug) {
+            MICROPROFILE_SCOPEI("llvm", "mem2reg", -1);
+
+            // Promoting allocas is cheap and makes instruction selection faster, since there is less code to select.
+            auto fpm = llvm::make_unique<legacy::FunctionPassManager>(llvm_module);
+            fpm->add(createPromoteMemoryToRegisterPass());
+            fpm->doInitialization();
+
+            for (auto &func : llvm_module->functions()) {
+                fpm->run(func);
+            }
 
-    for (auto &func : llvm_module->functions()) {
-        fpm->run(func);
+            fpm->doFinalization();
+        }
     }
-    */
 
     // llvm_module->dump();
     if (compiler->build_options.emit_llvm_ir) {
@@ -291,14 +483,46 @@ void LLVM_Generator::finalize() {
         free(ll_name.data);
     }
 
-    pass.add(createVerifierPass(false));
-    if (TargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
+    bool verify_module = !compiler->build_options.fast_debug;
+#ifdef DEBUG
+    verify_module = true; // Always verify in debug builds of the compiler.
+#endif
+
+    if (compiler->build_options.lto_mode != LTO_NONE) {
+        MICROPROFILE_SCOPEI("llvm", "write_bitcode", -1);
+
+        // The object file holds bitcode, code generation happens at link time.
+        if (verify_module && verifyModule(*llvm_module, &errs())) {
+            compiler->report_error((Ast *)nullptr, "LLVM module failed verification. This is a compiler bug.\n");
+            return;
+        }
+
+        if (compiler->build_options.lto_mode == LTO_THIN) {
+            // This also writes the module summary the thin link needs.
+            legacy::PassManager bitcode_pass;
+            bitcode_pass.add(createWriteThinLTOBitcodePass(dest));
+            bitcode_pass.run(*llvm_module);
+        } else {
+            WriteBitcodeToFile(*llvm_module, dest);
+        }
+
+        dest.flush();
+        free(obj_name.data);
+        return;
+    }
+
+    if (verify_module) pass.add(createVerifierPass(false));
+    if (TargetMachine->addPassesToEmitFile(pass, dest, dwo_dest.get(), FileType)) {
         compiler->report_error((Ast *)nullptr, "TargetMachine can't emit a file of this type"); // @TODO this error message is unclear for the user.
         return;
     }
 
-    pass.run(*llvm_module);
+    {
+        MICROPROFILE_SCOPEI("llvm", "codegen", -1);
+        pass.run(*llvm_module);
+    }
     dest.flush();
+    if (dwo_dest) dwo_dest->flush();
 
     free(obj_name.data);
 }
@@ -356,6 +580,97 @@ static bool is_c_pass_by_pointer_argument(TargetMachine *TM, Ast_Type_Info *info
     return true;
 }
 
+// Aggregates larger than this many bytes are initialized with memset and copied with memcpy. First-class
+// aggregate loads and stores get split into one load or store per element during instruction selection,
+// which is slow to compile and produces a lot of code for large structs and arrays.
+const s64 AGGREGATE_MEMCPY_THRESHOLD = 16;
+
+static bool is_large_aggregate(Ast_Type_Info *info) {
+    info = get_underlying_final_type(info);
+    if (info->type != Ast_Type_Info::STRUCT && info->type != Ast_Type_Info::ARRAY) return false;
+
+    return get_size(info) > AGGREGATE_MEMCPY_THRESHOLD;
+}
+
+static bool type_contains_known_size_array(Ast_Type_Info *info) {
+    info = get_underlying_final_type(info);
+    if (info->type == Ast_Type_Info::ARRAY) return info->array_element_count >= 0;
+    if (info->type != Ast_Type_Info::STRUCT) return false;
+
+    for (auto member : info->struct_members) {
+        if (type_contains_known_size_array(member.type_info)) return true;
+    }
+
+    if (info->parent_struct) return type_contains_known_size_array(info->parent_struct);
+    return false;
+}
+
+// Calling convention decisions, for both C functions and native jiyu functions. jiyu functions return
+// large aggregates through a hidden sret pointer and take them by a hidden pointer to the caller's value,
+// small ones go through registers as first-class values.
+// @Volatile make_llvm_type, get_or_create_function, emit_function and Ast_Function_Call generation must agree.
+static bool is_return_by_pointer_argument(TargetMachine *TM, Ast_Type_Info *function_type) {
+    assert(function_type->type == Ast_Type_Info::FUNCTION);
+
+    if (function_type->is_c_function) return is_c_return_by_pointer_argument(TM, function_type->return_type);
+    return is_large_aggregate(function_type->return_type);
+}
+
+static bool is_pass_by_pointer_argument(TargetMachine *TM, Ast_Type_Info *function_type, Ast_Type_Info *arg_type) {
+    assert(function_type->type == Ast_Type_Info::FUNCTION);
+
+    if (function_type->is_c_function) return is_c_pass_by_pointer_argument(TM, arg_type);
+    return is_large_aggregate(arg_type);
+}
+
+// The function a call expression calls directly, if any, as opposed to calling through a function pointer.
+static Ast_Function *get_direct_call_target(Ast_Expression *expression) {
+    while (expression->substitution) expression = expression->substitution;
+
+    if (expression->type == AST_FUNCTION) return static_cast<Ast_Function *>(expression);
+
+    if (expression->type == AST_IDENTIFIER) {
+        auto ident = static_cast<Ast_Identifier *>(expression);
+        if (ident->resolved_declaration && ident->resolved_declaration->type == AST_FUNCTION) {
+            return static_cast<Ast_Function *>(ident->resolved_declaration);
+        }
+    }
+
+    return nullptr;
+}
+
+// Arguments can't be assigned to, but elements of known-size arrays inside them are still writable
+// through [] and .data, so we can only promise LLVM that the callee doesn't write if there are none.
+static bool is_readonly_pointer_argument(Ast_Type_Info *function_type, Ast_Type_Info *arg_type) {
+    if (function_type->is_c_function) return false;
+    return !type_contains_known_size_array(arg_type);
+}
+
+// Whether the address of this lvalue is always a valid object, such as a variable or a field of one.
+// Addresses computed from pointers or dynamic arrays may be null, and array elements may be out of
+// range, so those are not considered.
+static bool address_is_known_valid(Ast_Expression *expression) {
+    while (expression->substitution) expression = expression->substitution;
+
+    if (expression->type == AST_IDENTIFIER) {
+        auto ident = static_cast<Ast_Identifier *>(expression);
+        return ident->resolved_declaration && ident->resolved_declaration->type == AST_DECLARATION;
+    }
+
+    if (expression->type == AST_DEREFERENCE) {
+        auto deref = static_cast<Ast_Dereference *>(expression);
+        if (!is_struct_type(get_type_info(deref->left))) return false;
+
+        return address_is_known_valid(deref->left);
+    }
+
+    return false;
+}
+
+static Attribute get_dereferenceable_attribute(LLVMContext *context, Ast_Type_Info *info) {
+    return Attribute::getWithDereferenceableBytes(*context, get_size(info));
+}
+
 Type *LLVM_Generator::make_llvm_type(Ast_Type_Info *type) {
     type = get_underlying_final_type(type);
 
@@ -422,6 +737,11 @@ Type *LLVM_Generator::make_llvm_type(Ast_Type_Info *type) {
         }
     }
 
+    if (type->type == Ast_Type_Info::VECTOR) {
+        auto element = make_llvm_type(type->array_element);
+        return VectorType::get(element, type->array_element_count);
+    }
+
     if (type->type == Ast_Type_Info::STRUCT) {
         // Prevent recursion.
         if (llvm_types[type->type_table_index]) {
@@ -508,18 +828,14 @@ Type *LLVM_Generator::make_llvm_type(Ast_Type_Info *type) {
     if (type->type == Ast_Type_Info::FUNCTION) {
         Array<Type *> arguments;
 
-        bool is_c_function = type->is_c_function;
-
         Type *return_type = make_llvm_type(get_underlying_final_type(type->return_type));
         if (type->return_type->type == Ast_Type_Info::VOID) {
             return_type = type_void;
         }
 
-        // C functions typically return aggregates through a pointer as their first argument.
-        // This may not be true depending on the size of the aggregate and the ABI @Incomplete.
-        // @Volatile should match functionality in Ast_Function_Call generation.
-        bool c_return_is_by_pointer_argument = is_c_function && is_c_return_by_pointer_argument(TargetMachine, type->return_type);
-        if (c_return_is_by_pointer_argument) {
+        // Large aggregates are returned through a pointer as the first argument.
+        // For C functions, this may not be true depending on the size of the aggregate and the ABI @Incomplete.
+        if (is_return_by_pointer_argument(TargetMachine, type)) {
             arguments.add(return_type->getPointerTo());
             return_type = type_void;
         }
@@ -528,19 +844,14 @@ Type *LLVM_Generator::make_llvm_type(Ast_Type_Info *type) {
             arg_type = get_underlying_final_type(arg_type);
             if (arg_type == compiler->type_void) continue;
 
-            Type *type = make_llvm_type(arg_type);
+            Type *llvm_type = make_llvm_type(arg_type);
 
-            if (is_c_function) {
-                if (is_c_pass_by_pointer_argument(TargetMachine, arg_type)) {
-                    arguments.add(type->getPointerTo());
-                    continue;
-                }
-            } else if (is_aggregate_type(arg_type)) {
-                arguments.add(type->getPointerTo());
+            if (is_pass_by_pointer_argument(TargetMachine, type, arg_type)) {
+                arguments.add(llvm_type->getPointerTo());
                 continue;
             }
 
-            arguments.add(type);
+            arguments.add(llvm_type);
         }
 
         return FunctionType::get(return_type, ArrayRef<Type *>(arguments.data, arguments.count), type->is_c_varargs)->getPointerTo();
@@ -655,6 +966,12 @@ DIType *LLVM_Generator::get_debug_type(Ast_Type_Info *type) {
         }
     }
 
+    if (type->type == Ast_Type_Info::VECTOR) {
+        auto element = get_debug_type(type->array_element);
+        auto subscripts = dib->getOrCreateArray({ dib->getOrCreateSubrange(0, type->array_element_count) });
+        return dib->createVectorType(type->size * BYTES_TO_BITS, type->alignment * BYTES_TO_BITS, element, subscripts);
+    }
+
     if (type->type == Ast_Type_Info::STRUCT) {
         if (type->debug_type_table_index >= 0) {
             return llvm_debug_types[type->debug_type_table_index];
@@ -769,10 +1086,27 @@ FunctionType *LLVM_Generator::create_function_type(Ast_Function *function) {
 }
 
 Value *LLVM_Generator::get_value_for_decl(Ast_Declaration *decl) {
-    for (auto &it : decl_value_map) {
-        if (it.item1 == decl) {
-            return it.item2;
-        }
+    // The index may be left over from a function we emitted earlier, so check that the slot is really ours.
+    auto index = decl->llvm_value_index;
+    if (index >= 0 && index < decl_value_map.count && decl_value_map[index].item1 == decl) {
+        return decl_value_map[index].item2;
+    }
+
+    return nullptr;
+}
+
+void LLVM_Generator::set_value_for_decl(Ast_Declaration *decl, Value *value) {
+    assert(get_value_for_decl(decl) == nullptr);
+
+    decl->llvm_value_index = decl_value_map.count;
+    decl_value_map.add(MakeTuple(decl, value));
+}
+
+static BasicBlock *find_jump_target(Array<Tuple<Ast_Expression *, BasicBlock *>> *map, Ast_Expression *target) {
+    // Search from the innermost statement outwards.
+    for (array_count_type i = map->count; i > 0; --i) {
+        auto &entry = (*map)[i-1];
+        if (entry.item1 == target) return entry.item2;
     }
 
     return nullptr;
@@ -825,6 +1159,231 @@ Value *LLVM_Generator::create_string_literal(Ast_Literal *lit, bool want_lvalue)
     return value;
 }
 
+// Strings are equal if they have the same length and the same bytes. This is a length check
+// followed by memcmp, which LLVM knows how to expand into a few wide loads when the length is
+// a constant, such as when comparing against a literal. Empty strings compare equal no matter
+// where their data points, which may be null.
+Value *LLVM_Generator::emit_string_equality(Value *left, Value *right) {
+    Value *left_length  = irb->CreateExtractValue(left,  1);
+    Value *right_length = irb->CreateExtractValue(right, 1);
+
+    // Once the lengths are known to match, either one will do, so prefer a constant.
+    Value *length = left_length;
+    if (isa<ConstantInt>(right_length)) length = right_length;
+
+    auto current_block = irb->GetInsertBlock();
+    auto func = current_block->getParent();
+
+    BasicBlock *length_match_block = BasicBlock::Create(*llvm_context, "string_length_match", func);
+    BasicBlock *compare_block      = BasicBlock::Create(*llvm_context, "string_compare", func);
+    BasicBlock *next_block         = BasicBlock::Create(*llvm_context, "string_compare_done", func);
+
+    irb->CreateCondBr(irb->CreateICmpEQ(left_length, right_length), length_match_block, next_block);
+
+    // A nonzero constant length always goes on to the compare, so then length_match_block
+    // is not a predecessor of next_block and must not appear in the phi.
+    bool length_match_reaches_next = true;
+
+    irb->SetInsertPoint(length_match_block);
+    if (auto constant = dyn_cast<ConstantInt>(length)) {
+        if (constant->isZero()) {
+            irb->CreateBr(next_block);
+        } else {
+            irb->CreateBr(compare_block);
+            length_match_reaches_next = false;
+        }
+    } else {
+        auto is_empty = irb->CreateICmpEQ(length, ConstantInt::get(length->getType(), 0));
+        irb->CreateCondBr(is_empty, next_block, compare_block);
+    }
+
+    irb->SetInsertPoint(compare_block);
+    Value *equal = nullptr;
+    {
+        // Declared with the C signature so that LLVM recognizes it as the library function.
+        auto memcmp_type = FunctionType::get(type_i32, { type_i8->getPointerTo(), type_i8->getPointerTo(), type_intptr }, false);
+        auto memcmp_func = llvm_module->getOrInsertFunction("memcmp", memcmp_type);
+
+        Value *left_data  = irb->CreateExtractValue(left,  0);
+        Value *right_data = irb->CreateExtractValue(right, 0);
+        Value *size = irb->CreateZExtOrTrunc(length, type_intptr);
+
+        auto result = irb->CreateCall(memcmp_func, { left_data, right_data, size });
+        equal = irb->CreateICmpEQ(result, ConstantInt::get(type_i32, 0));
+    }
+    irb->CreateBr(next_block);
+
+    irb->SetInsertPoint(next_block);
+    auto phi = irb->CreatePHI(type_i1, 3);
+    phi->addIncoming(ConstantInt::getFalse(*llvm_context), current_block);
+    if (length_match_reaches_next) phi->addIncoming(ConstantInt::getTrue(*llvm_context), length_match_block);
+    phi->addIncoming(equal, compare_block);
+
+    return phi;
+}
+
+// Traps unless 0 <= index < count. Negative signed indices wrap around to huge unsigned values,
+// so a single unsigned compare covers both ends. When count is loop-invariant and the index is a
+// loop counter, LLVM can usually hoist or remove this check at -O1 and above.
+void LLVM_Generator::emit_bounds_check(Value *index, Ast_Type_Info *index_type, Value *count) {
+    auto index_int_type = cast<IntegerType>(index->getType());
+    auto count_int_type = cast<IntegerType>(count->getType());
+
+    // Compare in the wider of the two types so that neither value gets truncated.
+    Type *compare_type = index_int_type;
+    if (count_int_type->getBitWidth() > index_int_type->getBitWidth()) compare_type = count_int_type;
+
+    if (index_type->is_signed) index = irb->CreateSExtOrTrunc(index, compare_type);
+    else                       index = irb->CreateZExtOrTrunc(index, compare_type);
+    count = irb->CreateZExtOrTrunc(count, compare_type);
+
+    auto in_bounds = irb->CreateICmpULT(index, count);
+    if (auto constant = dyn_cast<ConstantInt>(in_bounds)) {
+        if (constant->isOne()) return;
+    }
+
+    auto current_block = irb->GetInsertBlock();
+    BasicBlock *fail_block = BasicBlock::Create(*llvm_context, "bounds_check_fail", current_block->getParent());
+    BasicBlock *next_block = BasicBlock::Create(*llvm_context, "bounds_check_ok",   current_block->getParent());
+
+    auto branch_weights = MDBuilder(*llvm_context).createBranchWeights(1 << 20, 1);
+    irb->CreateCondBr(in_bounds, next_block, fail_block, branch_weights);
+
+    // The failure block keeps the current debug location, so a debugger stops on the offending line.
+    irb->SetInsertPoint(fail_block);
+    irb->CreateCall(Intrinsic::getDeclaration(llvm_module, Intrinsic::trap));
+    irb->CreateUnreachable();
+
+    irb->SetInsertPoint(next_block);
+}
+
+// Adds the access group to the groups this instruction already belongs to, which happens for nested loops.
+static void add_to_access_group(LLVMContext *context, Instruction *inst, MDNode *access_group) {
+    auto existing = inst->getMetadata(LLVMContext::MD_access_group);
+    if (!existing) {
+        inst->setMetadata(LLVMContext::MD_access_group, access_group);
+        return;
+    }
+
+    Array<Metadata *> groups;
+    if (existing->getNumOperands() == 0) {
+        groups.add(existing);
+    } else {
+        for (auto &op : existing->operands()) groups.add(op.get());
+    }
+    groups.add(access_group);
+
+    inst->setMetadata(LLVMContext::MD_access_group, MDNode::get(*context, ArrayRef<Metadata *>(groups.data, groups.count)));
+}
+
+// Whether the pointer is the same slot of a local variable on every iteration, like the loop's own it and
+// it_index, or a field of a local struct. Those carry real dependencies between iterations until mem2reg
+// promotes them, unlike elements of local arrays indexed by the loop.
+static bool is_fixed_local_slot(Value *pointer) {
+    while (true) {
+        if (auto gep = dyn_cast<GEPOperator>(pointer)) {
+            if (!gep->hasAllConstantIndices()) return false;
+            pointer = gep->getPointerOperand();
+        } else if (auto cast = dyn_cast<BitCastOperator>(pointer)) {
+            pointer = cast->getOperand(0);
+        } else {
+            break;
+        }
+    }
+
+    return isa<AllocaInst>(pointer);
+}
+
+// Attaches the loop directives as llvm.loop metadata on the back-edges of an emitted loop.
+// loop_entry is the block that branches into loop_header from outside the loop, every other
+// predecessor of the header is a back-edge.
+void LLVM_Generator::emit_loop_hints(Loop_Hints *hints, BasicBlock *loop_entry, BasicBlock *loop_header) {
+    if (hints->unroll_count < 0 && hints->vectorize_width < 0 && !hints->assume_no_alias) return;
+
+    auto context = llvm_context;
+
+    Array<BasicBlock *> latches;
+    for (auto pred : predecessors(loop_header)) {
+        if (pred != loop_entry) latches.add(pred);
+    }
+
+    if (!latches.count) return; // The body always breaks or returns, there is no loop to annotate.
+
+    Array<Metadata *> properties;
+    properties.add(nullptr); // The loop ID refers to itself, filled in below.
+
+    if (hints->unroll_count == 0) {
+        properties.add(MDNode::get(*context, MDString::get(*context, "llvm.loop.unroll.full")));
+    } else if (hints->unroll_count == 1) {
+        properties.add(MDNode::get(*context, MDString::get(*context, "llvm.loop.unroll.disable")));
+    } else if (hints->unroll_count > 1) {
+        properties.add(MDNode::get(*context, { MDString::get(*context, "llvm.loop.unroll.count"),
+                                               ConstantAsMetadata::get(ConstantInt::get(type_i32, hints->unroll_count)) }));
+    }
+
+    if (hints->vectorize_width == 1) {
+        // A width of one is how LLVM spells "don't vectorize".
+        properties.add(MDNode::get(*context, { MDString::get(*context, "llvm.loop.vectorize.width"),
+                                               ConstantAsMetadata::get(ConstantInt::get(type_i32, 1)) }));
+    } else if (hints->vectorize_width >= 0) {
+        properties.add(MDNode::get(*context, { MDString::get(*context, "llvm.loop.vectorize.enable"),
+                                               ConstantAsMetadata::get(ConstantInt::getTrue(*context)) }));
+
+        if (hints->vectorize_width > 1) {
+            properties.add(MDNode::get(*context, { MDString::get(*context, "llvm.loop.vectorize.width"),
+                                                   ConstantAsMetadata::get(ConstantInt::get(type_i32, hints->vectorize_width)) }));
+        }
+    }
+
+    if (hints->assume_no_alias) {
+        // Every memory access in the loop, other than fixed local slots, joins one access group and the loop
+        // is marked as having no dependencies between the iterations of that group. The loop's blocks are
+        // found by walking backwards from the back-edges up to the header.
+        MDNode *access_group = MDNode::getDistinct(*context, None);
+
+        Array<BasicBlock *> loop_blocks;
+        Array<BasicBlock *> worklist;
+        loop_blocks.add(loop_header);
+        for (auto latch : latches) worklist.add(latch);
+
+        while (worklist.count) {
+            auto block = worklist.pop();
+
+            bool seen = false;
+            for (auto it : loop_blocks) {
+                if (it == block) {
+                    seen = true;
+                    break;
+                }
+            }
+            if (seen) continue;
+
+            loop_blocks.add(block);
+            for (auto pred : predecessors(block)) worklist.add(pred);
+        }
+
+        for (auto block : loop_blocks) {
+            for (auto &inst : *block) {
+                if (!inst.mayReadOrWriteMemory()) continue;
+
+                auto pointer = getLoadStorePointerOperand(&inst);
+                if (pointer && is_fixed_local_slot(pointer)) continue;
+
+                add_to_access_group(context, &inst, access_group);
+            }
+        }
+
+        properties.add(MDNode::get(*context, { MDString::get(*context, "llvm.loop.parallel_accesses"), access_group }));
+    }
+
+    auto loop_id = MDNode::getDistinct(*context, ArrayRef<Metadata *>(properties.data, properties.count));
+    loop_id->replaceOperandWith(0, loop_id);
+
+    for (auto latch : latches) {
+        latch->getTerminator()->setMetadata(LLVMContext::MD_loop, loop_id);
+    }
+}
+
 Value *LLVM_Generator::dereference(Value *value, s64 element_path_index, bool is_lvalue) {
     // @TODO I think ideally, the front-end would change and dereferences of constant values with replaecments of literals of the value so that we can simplify LLVM code generation
     if (auto constant = dyn_cast<ConstantAggregate>(value)) {
@@ -911,17 +1470,39 @@ Constant *LLVM_Generator::get_constant_struct_initializer(Ast_Type_Info *info) {
     return ConstantStruct::get(llvm_type, ArrayRef<Constant *>(element_values.data, element_values.count));
 }
 
+static GlobalVariable *create_private_constant(Module *module, Constant *value, s64 alignment) {
+    auto global = new GlobalVariable(*module, value->getType(), /*isConstant=*/true, GlobalValue::LinkageTypes::PrivateLinkage, value);
+    global->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    global->setAlignment(alignment);
+    return global;
+}
+
 void LLVM_Generator::default_init_struct(Value *decl_value, Ast_Type_Info *info) {
     info = get_underlying_final_type(info);
 
     assert(info->type == Ast_Type_Info::STRUCT);
     assert(info->struct_decl);
 
-    auto _struct = info->struct_decl;
-
     auto initial_value = get_constant_struct_initializer(info);
     assert(initial_value->getType() == decl_value->getType()->getPointerElementType());
-    irb->CreateStore(initial_value, decl_value);
+
+    if (!is_large_aggregate(info) || initial_value->isNullValue()) {
+        create_store(initial_value, decl_value, info);
+        return;
+    }
+
+    // Large defaults with non-zero fields are copied from a private global, shared by every
+    // default-initialized value of this type.
+    if (info->type_table_index >= default_initializer_globals.count) default_initializer_globals.resize(info->type_table_index + 1);
+
+    auto global = default_initializer_globals[info->type_table_index];
+    if (!global) {
+        global = create_private_constant(llvm_module, initial_value, get_alignment(info));
+        default_initializer_globals[info->type_table_index] = global;
+    }
+
+    auto i8_ptr = type_i8->getPointerTo();
+    irb->CreateMemCpy(irb->CreateBitCast(decl_value, i8_ptr), get_alignment(info), irb->CreateBitCast(global, i8_ptr), get_alignment(info), get_size(info));
 
     // s32 element_path_index = 0;
     // for (auto member: _struct->member_scope.declarations) {
@@ -952,6 +1533,47 @@ void LLVM_Generator::default_init_struct(Value *decl_value, Ast_Type_Info *info)
     // }
 }
 
+// Stores _value_ of type _info_ to _dest_. For large aggregates this avoids first-class aggregate stores:
+// zero values become a memset, other constants are copied from a private global, and values that were
+// just loaded from memory are copied from that memory directly.
+void LLVM_Generator::create_store(Value *value, Value *dest, Ast_Type_Info *info) {
+    if (!is_large_aggregate(info)) {
+        irb->CreateStore(value, dest);
+        return;
+    }
+
+    info = get_underlying_final_type(info);
+    auto size  = get_size(info);
+    auto align = get_alignment(info);
+    auto i8_ptr = type_i8->getPointerTo();
+
+    if (auto constant = dyn_cast<Constant>(value)) {
+        if (constant->isNullValue()) {
+            irb->CreateMemSet(irb->CreateBitCast(dest, i8_ptr), ConstantInt::get(type_i8, 0), size, align);
+            return;
+        }
+
+        auto global = create_private_constant(llvm_module, constant, align);
+        irb->CreateMemCpy(irb->CreateBitCast(dest, i8_ptr), align, irb->CreateBitCast(global, i8_ptr), align, size);
+        return;
+    }
+
+    if (auto load = dyn_cast<LoadInst>(value)) {
+        // The load was the last thing emitted for the right-hand side, so its memory hasn't changed since.
+        // The source may be the destination itself, as in a = a, or alias it through pointers and by-pointer
+        // arguments, so this has to be a memmove. LLVM turns it into a memcpy where it can prove they don't overlap.
+        auto source = load->getPointerOperand();
+        if (source->stripPointerCasts() != dest->stripPointerCasts()) {
+            irb->CreateMemMove(irb->CreateBitCast(dest, i8_ptr), align, irb->CreateBitCast(source, i8_ptr), align, size);
+        }
+
+        if (load->use_empty()) load->eraseFromParent();
+        return;
+    }
+
+    irb->CreateStore(value, dest);
+}
+
 Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalue) {
     while(expression->substitution) expression = expression->substitution;
 
@@ -985,7 +1607,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 return value;
             } else if (un->operator_type == Token::MINUS) {
                 auto value = emit_expression(un->expression);
-                auto type = get_type_info(un->expression);
+                auto type = get_scalar_type(get_type_info(un->expression));
 
                 if (is_int_or_enum_type(type)) {
                     return irb->CreateNeg(value);
@@ -1029,7 +1651,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 Value *left  = emit_expression(bin->left,  true);
                 Value *right = emit_expression(bin->right, false);
 
-                irb->CreateStore(right, left);
+                create_store(right, left, get_type_info(bin->left));
                 return nullptr;
             } else {
                 Value *left  = emit_expression(bin->left,  false);
@@ -1038,7 +1660,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 // @TODO NUW NSW?
                 switch (bin->operator_type) {
                     case Token::STAR: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_int_or_enum_type(info)) {
                             return irb->CreateMul(left, right);
                         } else {
@@ -1047,7 +1669,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                         }
                     }
                     case Token::PERCENT: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_int_or_enum_type(info)) {
                             if (info->is_signed) {
                                 return irb->CreateSRem(left, right);
@@ -1060,7 +1682,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                         }
                     }
                     case Token::SLASH: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_int_or_enum_type(info)) {
                             if (info->is_signed) {
                                 return irb->CreateSDiv(left, right);
@@ -1074,8 +1696,8 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                     }
 
                     case Token::PLUS: {
-                        auto left_type = get_type_info(bin->left);
-                        auto right_type = get_type_info(bin->right);
+                        auto left_type = get_scalar_type(get_type_info(bin->left));
+                        auto right_type = get_scalar_type(get_type_info(bin->right));
 
                         if (is_pointer_type(left_type) &&
                             is_int_or_enum_type(right_type)) {
@@ -1095,8 +1717,8 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                         return irb->CreateAdd(left, right);
                     }
                     case Token::MINUS: {
-                        auto left_type  = get_type_info(bin->left);
-                        auto right_type = get_type_info(bin->right);
+                        auto left_type  = get_scalar_type(get_type_info(bin->left));
+                        auto right_type = get_scalar_type(get_type_info(bin->right));
 
                         if (is_pointer_type(left_type) && is_pointer_type(right_type)) {
                             Value *left_int  = irb->CreatePtrToInt(left,  type_intptr);
@@ -1113,23 +1735,27 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                         return irb->CreateSub(left, right);
                     }
                     case Token::EQ_OP: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_float_type(info)) {
                             return irb->CreateFCmpUEQ(left, right);
+                        } else if (get_underlying_final_type(info)->type == Ast_Type_Info::STRING) {
+                            return emit_string_equality(left, right);
                         } else {
                             return irb->CreateICmpEQ(left, right);
                         }
                     }
                     case Token::NE_OP: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_float_type(info)) {
                             return irb->CreateFCmpUNE(left, right);
+                        } else if (get_underlying_final_type(info)->type == Ast_Type_Info::STRING) {
+                            return irb->CreateNot(emit_string_equality(left, right));
                         } else {
                             return irb->CreateICmpNE(left, right);
                         }
                     }
                     case Token::LE_OP: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_int_or_enum_type(info)) {
                             if (info->is_signed) {
                                 return irb->CreateICmpSLE(left, right);
@@ -1142,7 +1768,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                         }
                     }
                     case Token::GE_OP: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_int_or_enum_type(info)) {
                             if (info->is_signed) {
                                 return irb->CreateICmpSGE(left, right);
@@ -1156,7 +1782,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                     }
 
                     case Token::LEFT_ANGLE: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_int_or_enum_type(info)) {
                             if (info->is_signed) {
                                 return irb->CreateICmpSLT(left, right);
@@ -1170,7 +1796,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                     }
 
                     case Token::RIGHT_ANGLE: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
                         if (is_int_or_enum_type(info)) {
                             if (info->is_signed) {
                                 return irb->CreateICmpSGT(left, right);
@@ -1214,7 +1840,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                     }
 
                     case Token::RIGHT_SHIFT: {
-                        auto info = get_type_info(bin->left);
+                        auto info = get_scalar_type(get_type_info(bin->left));
 
                         if (info->is_signed) {
                             return irb->CreateAShr(left, right);
@@ -1245,7 +1871,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 case Ast_Literal::FLOAT:   return ConstantFP::get(type,  lit->float_value);
                 case Ast_Literal::BOOL:    return ConstantInt::get(type, (lit->bool_value ? 1 : 0));
                 case Ast_Literal::NULLPTR: return ConstantPointerNull::get(static_cast<PointerType *>(type));
-                case Ast_Literal::FUNCTION:return get_or_create_function(lit->function);
+                case Ast_Literal::FUNCTION:return get_function_address(lit->function);
             }
         }
 
@@ -1277,7 +1903,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             } else if (ident->resolved_declaration->type == AST_FUNCTION) {
                 auto func = static_cast<Ast_Function *>(ident->resolved_declaration);
 
-                return get_or_create_function(func);
+                return get_function_address(func);
             } else if (is_a_type_declaration(ident->resolved_declaration)) {
                 Ast_Type_Info *type_value = get_type_declaration_resolved_type(ident->resolved_declaration);
 
@@ -1304,7 +1930,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             auto decl_value = get_value_for_decl(decl);
             if (decl->initializer_expression) {
                 auto value = emit_expression(decl->initializer_expression);
-                irb->CreateStore(value, decl_value);
+                create_store(value, decl_value, get_type_info(decl));
             } else {
                 // if a declaration does not have an initializer, initialize to 0
                 auto type_info = get_type_info(decl);
@@ -1312,7 +1938,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                     default_init_struct(decl_value, type_info);
                 } else {
                     auto type = decl_value->getType()->getPointerElementType();
-                    irb->CreateStore(Constant::getNullValue(type), decl_value);
+                    create_store(Constant::getNullValue(type), decl_value, type_info);
                 }
             }
             return nullptr;
@@ -1324,15 +1950,27 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             auto type_info = get_underlying_final_type(get_type_info(call->function_or_function_ptr));
             assert(type_info->type == Ast_Type_Info::FUNCTION);
 
-            auto function_target = emit_expression(call->function_or_function_ptr);
+            // Direct calls go straight to the function so that it keeps its own calling convention,
+            // taking the address of a function forces it to use the C calling convention.
+            Value *function_target = nullptr;
+            auto direct_target = get_direct_call_target(call->function_or_function_ptr);
+            if (direct_target && direct_target->intrinsic_kind != INTRINSIC_NONE) {
+                return emit_intrinsic_call(call, direct_target);
+            }
+
+            if (direct_target) {
+                function_target = get_or_create_function(direct_target);
+            } else {
+                function_target = emit_expression(call->function_or_function_ptr);
+            }
             assert(function_target);
 
             bool is_c_function = type_info->is_c_function;
 
-            bool c_return_is_by_pointer_argument = is_c_function && is_c_return_by_pointer_argument(TargetMachine, type_info->return_type);
+            bool return_is_by_pointer_argument = is_return_by_pointer_argument(TargetMachine, type_info);
 
             Array<Value *> args;
-            if (c_return_is_by_pointer_argument) {
+            if (return_is_by_pointer_argument) {
                 auto alloca = create_alloca_in_entry(this, irb, type_info->return_type); // Reserve storage for the return value.
                 args.add(alloca);
             }
@@ -1341,9 +1979,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 auto info = get_underlying_final_type(get_type_info(it));
                 assert(get_size(info) >= 0);
 
-                bool is_pass_by_pointer_aggregate = is_aggregate_type(info);
-
-                if (is_c_function) is_pass_by_pointer_aggregate = is_c_pass_by_pointer_argument(TargetMachine, info);
+                bool is_pass_by_pointer_aggregate = is_pass_by_pointer_argument(TargetMachine, type_info, info);
 
                 auto value = emit_expression(it, is_pass_by_pointer_aggregate);
                 args.add(value);
@@ -1372,9 +2008,38 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 }
             }
 
-            Value *result = irb->CreateCall(function_target, ArrayRef<Value *>(args.data, args.count));
+            auto call_inst = irb->CreateCall(function_target, ArrayRef<Value *>(args.data, args.count));
+
+            if (auto callee = dyn_cast<Function>(function_target)) {
+                call_inst->setCallingConv(callee->getCallingConv());
+            }
+
+            unsigned first_argument = 0;
+            if (return_is_by_pointer_argument) {
+                if (!is_c_function) call_inst->addParamAttr(0, Attribute::StructRet);
+                first_argument = 1;
+            }
+
+            // Addresses of variables, like the implicit struct argument of a method call, are never null.
+            for (array_count_type i = 0; i < call->argument_list.count; ++i) {
+                auto arg = call->argument_list[i];
+                while (arg->substitution) arg = arg->substitution;
+
+                if (arg->type != AST_UNARY_EXPRESSION) continue;
+
+                auto un = static_cast<Ast_Unary_Expression *>(arg);
+                if (un->operator_type != Token::STAR || !address_is_known_valid(un->expression)) continue;
+
+                unsigned arg_index = first_argument + i;
+                call_inst->addParamAttr(arg_index, Attribute::NonNull);
+
+                auto pointee = get_type_info(un->expression);
+                if (get_size(pointee) > 0) call_inst->addParamAttr(arg_index, get_dereferenceable_attribute(llvm_context, pointee));
+            }
+
+            Value *result = call_inst;
 
-            if (c_return_is_by_pointer_argument) {
+            if (return_is_by_pointer_argument) {
                 result = args[0];
                 if (is_lvalue) return result;
                 return irb->CreateLoad(result);
@@ -1445,6 +2110,16 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             if (dst->type == Ast_Type_Info::ENUM) dst = dst->enum_base_type;
 
             auto dst_type = get_type(dst);
+
+            if (dst->type == Ast_Type_Info::VECTOR) {
+                // Sema already converted splatted scalars to the element type.
+                if (src->type != Ast_Type_Info::VECTOR) return irb->CreateVectorSplat(dst->array_element_count, value);
+
+                // The cast instructions below all work element-wise on vectors, we just pick them by element type.
+                src = get_underlying_final_type(src->array_element);
+                dst = get_underlying_final_type(dst->array_element);
+            }
+
             if (is_int_or_enum_type(src) && is_int_or_enum_type(dst)) {
                 if (src->size > dst->size) {
                     return irb->CreateTrunc(value, dst_type);
@@ -1456,7 +2131,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                     }
                 }
 
-                assert(get_type(src) == dst_type);
+                assert(value->getType() == dst_type);
                 return value;
             } else if (is_float_type(src) && is_float_type(dst)) {
                 if (src->size < dst->size) {
@@ -1465,7 +2140,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                     return irb->CreateFPTrunc(value, dst_type);
                 }
 
-                assert(get_type(src) == dst_type);
+                assert(value->getType() == dst_type);
                 return value;
             } else if (is_float_type(src) && is_int_type(dst)) {
                 if (dst->is_signed) {
@@ -1565,6 +2240,11 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 if (!irb->GetInsertBlock()->getTerminator()) irb->CreateBr(loop_header);
             }
 
+            emit_loop_hints(&loop->hints, current_block, loop_header);
+
+            loop_header_map.pop();
+            loop_exit_map.pop();
+
             auto current_debug_loc = irb->getCurrentDebugLocation();
             irb->SetInsertPoint(next_block);
             irb->SetCurrentDebugLocation(current_debug_loc);
@@ -1578,7 +2258,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             auto it_alloca = create_alloca_in_entry(this, irb, get_type_info(it_decl));
             auto decl_type = get_type_info(it_decl);
 
-            decl_value_map.add(MakeTuple(it_decl, it_alloca));
+            set_value_for_decl(it_decl, it_alloca);
 
             auto it_index_decl = _for->iterator_index_decl;
             Ast_Type_Info *it_index_type = nullptr;
@@ -1586,7 +2266,7 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             if (it_index_decl) {
                 it_index_type = get_type_info(it_index_decl);
                 it_index_alloca = create_alloca_in_entry(this, irb, it_index_type);
-                decl_value_map.add(MakeTuple(it_index_decl, it_index_alloca));
+                set_value_for_decl(it_index_decl, it_index_alloca);
                 emit_expression(it_index_decl);
             } else {
                 it_index_type = decl_type;
@@ -1595,6 +2275,32 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 emit_expression(it_decl);
             }
 
+            assert(is_int_type(it_index_type));
+
+            // The bounds, and for fixed-size arrays the base pointer, are evaluated once before the loop.
+            // Reloading them every iteration keeps LLVM from proving that the body does not change them,
+            // which is usually enough for the vectorizer to give up on the loop.
+            // Dynamic arrays and slices are the exception, the body may reallocate or reassign them, so their
+            // count and data are reloaded each iteration. LLVM still hoists those loads when the body provably
+            // leaves the array alone.
+            Value *upper = nullptr;
+            Value *element_base = nullptr;
+            Value *array = nullptr;
+            if (it_index_decl) {
+                auto array_type = get_underlying_final_type(get_type_info(_for->initial_iterator_expression));
+                assert(array_type->type == Ast_Type_Info::ARRAY);
+
+                array = emit_expression(_for->initial_iterator_expression, true);
+
+                if (array_type->array_element_count >= 0) {
+                    element_base = irb->CreateGEP(array, {ConstantInt::get(type_i32, 0), ConstantInt::get(type_i32, 0)});
+                    upper = ConstantInt::get(get_type(it_index_type), array_type->array_element_count);
+                    array = nullptr;
+                }
+            } else {
+                upper = emit_expression(_for->upper_range_expression);
+            }
+
             auto current_block = irb->GetInsertBlock();
 
             BasicBlock *loop_header = BasicBlock::Create(*llvm_context, "for_header", current_block->getParent());
@@ -1611,14 +2317,19 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             irb->SetInsertPoint(loop_header);
             // emit the condition in the loop header so that it always executes when we loop back around
             auto it_index = irb->CreateLoad(it_index_alloca);
-            assert(is_int_type(it_index_type));
 
-            auto upper = emit_expression(_for->upper_range_expression);
+            // @Cleanup hardcoded indices
+            if (array) upper = irb->CreateLoad(irb->CreateGEP(array, {ConstantInt::get(type_i32, 0), ConstantInt::get(type_i32, 1)}));
+
+            // Half-open loops never step past upper, which itself fits in the type, so the increment
+            // can't wrap. Array indices count up from zero, so they also can't wrap as unsigned.
+            bool is_half_open = it_index_decl || _for->is_exclusive_end;
+            bool increment_has_no_signed_wrap   = is_half_open && (it_index_type->is_signed || it_index_decl);
+            bool increment_has_no_unsigned_wrap = is_half_open && (!it_index_type->is_signed || it_index_decl);
+
             Value *cond = nullptr;
-            if (it_index_decl || _for->is_exclusive_end) {
+            if (is_half_open) {
                 // use < here otherwise, we'll overstep by one.
-                // @Cleanup maybe this should be flagged as a half-open loop
-                // when we support that?
                 if (it_index_type->is_signed) {
                     cond = irb->CreateICmpSLT(it_index, upper);
                 } else {
@@ -1637,7 +2348,17 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
 
             irb->SetInsertPoint(loop_body);
             if (it_index_decl) {
-                emit_expression(it_decl);
+                // it_index was just checked against the count, so the element address comes straight
+                // from the index. This raw GEP is what keeps -bounds-check from checking the implicit
+                // element access on every iteration.
+                if (array) element_base = irb->CreateLoad(irb->CreateGEP(array, {ConstantInt::get(type_i32, 0), ConstantInt::get(type_i32, 0)}));
+                auto element = irb->CreateInBoundsGEP(element_base, it_index);
+
+                if (_for->is_element_pointer_iteration) {
+                    irb->CreateStore(element, it_alloca);
+                } else {
+                    create_store(irb->CreateLoad(element), it_alloca, decl_type);
+                }
             }
 
             emit_scope(&_for->body);
@@ -1645,9 +2366,16 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             if (!irb->GetInsertBlock()->getTerminator()) irb->CreateBr(loop_body_end);
 
             irb->SetInsertPoint(loop_body_end);
-            irb->CreateStore(irb->CreateAdd(it_index, ConstantInt::get(get_type(it_index_type), 1)), it_index_alloca);
+            auto next_index = irb->CreateAdd(it_index, ConstantInt::get(get_type(it_index_type), 1), "",
+                                             increment_has_no_unsigned_wrap, increment_has_no_signed_wrap);
+            irb->CreateStore(next_index, it_index_alloca);
             irb->CreateBr(loop_header);
 
+            emit_loop_hints(&_for->hints, current_block, loop_header);
+
+            loop_header_map.pop();
+            loop_exit_map.pop();
+
             irb->SetInsertPoint(next_block);
             break;
         }
@@ -1657,7 +2385,13 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             if (ret->expression) {
                 auto value = emit_expression(ret->expression);
                 assert(value);
-                irb->CreateRet(value);
+
+                if (return_pointer) {
+                    create_store(value, return_pointer, get_type_info(ret->expression));
+                    irb->CreateRetVoid();
+                } else {
+                    irb->CreateRet(value);
+                }
             } else {
                 irb->CreateRetVoid();
             }
@@ -1677,13 +2411,36 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
         case AST_ARRAY_DEREFERENCE: {
             auto deref = static_cast<Ast_Array_Dereference *>(expression);
 
+            if (!is_lvalue && is_vector_type(get_type_info(deref->array_or_pointer_expression))) {
+                // Reading a single lane doesn't need the vector to live in memory.
+                auto vector_type = get_underlying_final_type(get_type_info(deref->array_or_pointer_expression));
+
+                auto vector = emit_expression(deref->array_or_pointer_expression);
+                auto index  = emit_expression(deref->index_expression);
+
+                if (compiler->build_options.bounds_check) {
+                    emit_bounds_check(index, get_type_info(deref->index_expression), ConstantInt::get(type_intptr, vector_type->array_element_count));
+                }
+
+                return irb->CreateExtractElement(vector, index);
+            }
+
             auto array = emit_expression(deref->array_or_pointer_expression, true);
             auto index = emit_expression(deref->index_expression);
 
             auto type = get_type_info(deref->array_or_pointer_expression);
             type = get_underlying_final_type(type);
 
+            bool check_bounds = compiler->build_options.bounds_check;
+            auto index_type = get_type_info(deref->index_expression);
+
             if (type->type == Ast_Type_Info::ARRAY && type->array_element_count == -1) {
+                if (check_bounds) {
+                    // @Cleanup hardcoded indices
+                    auto count = irb->CreateLoad(irb->CreateGEP(array, {ConstantInt::get(type_i32, 0), ConstantInt::get(type_i32, 1)}));
+                    emit_bounds_check(index, index_type, count);
+                }
+
                 // @Cleanup hardcoded indices
                 array = irb->CreateGEP(array, {ConstantInt::get(type_i32, 0), ConstantInt::get(type_i32, 0)});
                 array = irb->CreateLoad(array);
@@ -1695,6 +2452,12 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 // @Note although this is identical to the dynamic/static array case,
                 // I've chosen to duplicate the code in case we chnage the order of
                 // any of these implicit struct fields.
+                if (check_bounds) {
+                    // @Cleanup hardcoded indices
+                    auto length = irb->CreateLoad(irb->CreateGEP(array, {ConstantInt::get(type_i32, 0), ConstantInt::get(type_i32, 1)}));
+                    emit_bounds_check(index, index_type, length);
+                }
+
                 // @Cleanup hardcoded indices.
                 array = irb->CreateGEP(array, {ConstantInt::get(type_i32, 0), ConstantInt::get(type_i32, 0)});
                 array = irb->CreateLoad(array);
@@ -1710,6 +2473,10 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 return element;
             }
 
+            if (check_bounds) {
+                emit_bounds_check(index, index_type, ConstantInt::get(type_intptr, type->array_element_count));
+            }
+
             // @Cleanup type_i32 use for array indexing
             auto element = irb->CreateGEP(array, {ConstantInt::get(type_i32, 0), index});
 
@@ -1726,22 +2493,21 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             }
 
             // we only need the header to be generated when we come here, only the compiler instance can choose to emit a function.
-            return get_or_create_function(func);
+            return get_function_address(func);
         }
 
         case AST_CONTROL_FLOW: {
             auto flow = static_cast<Ast_Control_Flow *>(expression);
 
+            BasicBlock *target = nullptr;
             if (flow->control_type == Token::KEYWORD_BREAK) {
-                for (auto &entry : loop_exit_map) {
-                    if (entry.item1 == flow->target_statement) return irb->CreateBr(entry.item2);
-                }
+                target = find_jump_target(&loop_exit_map, flow->target_statement);
             } else if (flow->control_type == Token::KEYWORD_CONTINUE) {
-                for (auto &entry : loop_header_map) {
-                    if (entry.item1 == flow->target_statement) return irb->CreateBr(entry.item2);
-                }
+                target = find_jump_target(&loop_header_map, flow->target_statement);
             }
 
+            if (target) return irb->CreateBr(target);
+
             assert(false && "Could not find LLVM BasicBlock for control-flow statement.");
             return nullptr;
         }
@@ -1791,6 +2557,8 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
                 }
             }
 
+            loop_exit_map.pop();
+
 
             irb->SetInsertPoint(next_block);
 
@@ -1811,12 +2579,8 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
             irb->SetInsertPoint(block);
             emit_scope(&_case->scope);
             if (!irb->GetInsertBlock()->getTerminator()) {
-                for (auto &entry : loop_exit_map) {
-                    if (entry.item1 == _case->target_switch) {
-                        irb->CreateBr(entry.item2);
-                        break;
-                    }
-                }
+                auto target = find_jump_target(&loop_exit_map, _case->target_switch);
+                if (target) irb->CreateBr(target);
 
                 assert(irb->GetInsertBlock()->getTerminator());
             }
@@ -1838,6 +2602,49 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
         case AST_DIRECTIVE_CLANG_IMPORT:
         case AST_LIBRARY:
             break;
+        case AST_VECTOR_BUILTIN: {
+            auto builtin = static_cast<Ast_Vector_Builtin *>(expression);
+            auto vector = emit_expression(builtin->arguments[0]);
+
+            if (builtin->builtin_kind == Ast_Vector_Builtin::SHUFFLE) {
+                // Swizzles only have one source vector.
+                Value *second = nullptr;
+                if (builtin->arguments.count > 1) second = emit_expression(builtin->arguments[1]);
+                else                              second = UndefValue::get(vector->getType());
+
+                Array<Constant *> mask;
+                for (auto lane: builtin->shuffle_mask) {
+                    mask.add(ConstantInt::get(type_i32, lane));
+                }
+
+                return irb->CreateShuffleVector(vector, second, ConstantVector::get(ArrayRef<Constant *>(mask.data, mask.count)));
+            }
+
+            auto element = get_scalar_type(get_type_info(builtin->arguments[0]));
+            bool is_float = is_float_type(element);
+
+            // Float add/mul reductions are ordered, matching the scalar loop they replace.
+            switch (builtin->builtin_kind) {
+                case Ast_Vector_Builtin::REDUCE_ADD:
+                    if (is_float) return irb->CreateFAddReduce(ConstantFP::get(get_type(element), -0.0), vector);
+                    return irb->CreateAddReduce(vector);
+                case Ast_Vector_Builtin::REDUCE_MUL:
+                    if (is_float) return irb->CreateFMulReduce(ConstantFP::get(get_type(element), 1.0), vector);
+                    return irb->CreateMulReduce(vector);
+                case Ast_Vector_Builtin::REDUCE_MIN:
+                    if (is_float) return irb->CreateFPMinReduce(vector);
+                    return irb->CreateIntMinReduce(vector, element->is_signed);
+                case Ast_Vector_Builtin::REDUCE_MAX:
+                    if (is_float) return irb->CreateFPMaxReduce(vector);
+                    return irb->CreateIntMaxReduce(vector, element->is_signed);
+                default:
+                    assert(false);
+                    break;
+            }
+
+            break;
+        }
+
         case AST_TYPE_INSTANTIATION:
         case AST_OS:      // This is always subtituted by a literal at the AST level.
         case AST_SIZEOF:  // This is always subtituted by a literal at the AST level.
@@ -1852,14 +2659,8 @@ Value *LLVM_Generator::emit_expression(Ast_Expression *expression, bool is_lvalu
 
 Function *LLVM_Generator::get_or_create_function(Ast_Function *function) {
 
-    if (function->is_intrinsic) {
-        if (function->identifier->name == compiler->atom_builtin_debugtrap) {
-            return Intrinsic::getDeclaration(llvm_module, Intrinsic::debugtrap);
-        }
-
-        assert(false);
-        return nullptr;
-    }
+    // Intrinsics are expanded at the call site, see emit_intrinsic_call.
+    assert(function->intrinsic_kind == INTRINSIC_NONE);
 
     assert(function->identifier);
     String linkage_name = function->linkage_name;
@@ -1875,12 +2676,63 @@ Function *LLVM_Generator::get_or_create_function(Ast_Function *function) {
 
         func = Function::Create(function_type, linkage, string_ref(linkage_name), llvm_module);
 
-        array_count_type i = 0;
-        for (auto &a : func->args()) {
-            if (i < function->arguments.count) {
-                a.setName(string_ref(function->arguments[i]->identifier->name->name));
+        // Nothing outside of this module can call internal functions, so they can use a faster
+        // calling convention. This is undone if the function's address is taken, see get_function_address.
+        if (linkage == GlobalValue::LinkageTypes::InternalLinkage) {
+            func->setCallingConv(CallingConv::Fast);
+        }
+
+        auto type_info = get_underlying_final_type(get_type_info(function));
+
+        // jiyu has no exceptions, so nothing we compile can unwind.
+        if (!type_info->is_c_function || function->scope) {
+            func->addFnAttr(Attribute::NoUnwind);
+        }
+
+        if (function->is_marked_inline)   func->addFnAttr(Attribute::AlwaysInline);
+        if (function->is_marked_noinline) func->addFnAttr(Attribute::NoInline);
+
+        // The section prefixes group hot and cold functions together in the final binary, the same as profile-guided builds do.
+        if (function->is_marked_cold) {
+            func->addFnAttr(Attribute::Cold);
+            func->addFnAttr(Attribute::OptimizeForSize);
+            func->setSectionPrefix(".unlikely");
+        } else if (function->is_marked_hot) {
+            func->setSectionPrefix(".hot");
+        }
+
+        unsigned first_argument = 0;
+        if (is_return_by_pointer_argument(TargetMachine, type_info)) {
+            if (!type_info->is_c_function) {
+                func->addParamAttr(0, Attribute::StructRet);
+                func->addParamAttr(0, Attribute::NoAlias);
+                func->addParamAttr(0, Attribute::NonNull);
+                func->addParamAttr(0, get_dereferenceable_attribute(llvm_context, type_info->return_type));
+            }
+
+            first_argument = 1;
+        }
+
+        for (array_count_type i = 0; i < function->arguments.count; ++i) {
+            unsigned arg_index = first_argument + i;
+            if (arg_index >= func->arg_size()) break;
 
-                ++i;
+            Argument *arg = func->arg_begin() + arg_index;
+            arg->setName(string_ref(function->arguments[i]->identifier->name->name));
+
+            if (type_info->is_c_function) continue;
+
+            // Pointers to large aggregates point at the caller's value without a copy. That value may also be
+            // reachable through other arguments or globals, as in f(m, m), so the pointer is not noalias.
+            auto arg_type = get_type_info(function->arguments[i]);
+            if (is_pass_by_pointer_argument(TargetMachine, type_info, arg_type)) {
+                func->addParamAttr(arg_index, Attribute::NonNull);
+                func->addParamAttr(arg_index, get_dereferenceable_attribute(llvm_context, arg_type));
+
+                if (is_readonly_pointer_argument(type_info, arg_type)) {
+                    func->addParamAttr(arg_index, Attribute::ReadOnly);
+                    func->addParamAttr(arg_index, Attribute::NoCapture);
+                }
             }
         }
     }
@@ -1888,9 +2740,116 @@ Function *LLVM_Generator::get_or_create_function(Ast_Function *function) {
     return func;
 }
 
+Value *LLVM_Generator::emit_intrinsic_call(Ast_Function_Call *call, Ast_Function *function) {
+    auto kind = function->intrinsic_kind;
+
+    Array<Value *> args;
+    for (auto it : call->argument_list) {
+        args.add(emit_expression(it));
+    }
+
+    switch (kind) {
+        case INTRINSIC_NONE:
+            assert(false);
+            return nullptr;
+
+        case INTRINSIC_DEBUGTRAP:
+            return irb->CreateCall(Intrinsic::getDeclaration(llvm_module, Intrinsic::debugtrap));
+
+        case INTRINSIC_CTPOP:
+        case INTRINSIC_BSWAP:
+        case INTRINSIC_SQRT: {
+            Intrinsic::ID id = Intrinsic::ctpop;
+            if (kind == INTRINSIC_BSWAP) id = Intrinsic::bswap;
+            if (kind == INTRINSIC_SQRT)  id = Intrinsic::sqrt;
+
+            return irb->CreateCall(Intrinsic::getDeclaration(llvm_module, id, { args[0]->getType() }), { args[0] });
+        }
+
+        case INTRINSIC_CTLZ:
+        case INTRINSIC_CTTZ: {
+            Intrinsic::ID id = (kind == INTRINSIC_CTLZ) ? Intrinsic::ctlz : Intrinsic::cttz;
+
+            // Zero is defined to return the bit width, like lzcnt and tzcnt.
+            return irb->CreateCall(Intrinsic::getDeclaration(llvm_module, id, { args[0]->getType() }), { args[0], irb->getFalse() });
+        }
+
+        case INTRINSIC_FMA:
+            return irb->CreateCall(Intrinsic::getDeclaration(llvm_module, Intrinsic::fma, { args[0]->getType() }), { args[0], args[1], args[2] });
+
+        case INTRINSIC_RSQRT: {
+            // There is no reciprocal square root intrinsic, the backend can use rsqrtss and friends for this
+            // pattern when fast-math allows it.
+            auto type = args[0]->getType();
+            auto root = irb->CreateCall(Intrinsic::getDeclaration(llvm_module, Intrinsic::sqrt, { type }), { args[0] });
+            return irb->CreateFDiv(ConstantFP::get(type, 1.0), root);
+        }
+
+        case INTRINSIC_PREFETCH: {
+            // Sema guarantees these are literals.
+            auto write    = cast<ConstantInt>(args[1]);
+            auto locality = cast<ConstantInt>(args[2]);
+
+            auto address = irb->CreatePointerCast(args[0], type_i8->getPointerTo());
+
+            // llvm.prefetch only became overloaded on the address space in later LLVM versions.
+            Function *prefetch = nullptr;
+            if (Intrinsic::isOverloaded(Intrinsic::prefetch)) {
+                prefetch = Intrinsic::getDeclaration(llvm_module, Intrinsic::prefetch, { address->getType() });
+            } else {
+                prefetch = Intrinsic::getDeclaration(llvm_module, Intrinsic::prefetch);
+            }
+
+            Value *prefetch_args[] = {
+                address,
+                ConstantInt::get(type_i32, write->getZExtValue()),
+                ConstantInt::get(type_i32, locality->getZExtValue()),
+                ConstantInt::get(type_i32, 1), // Data cache
+            };
+            return irb->CreateCall(prefetch, prefetch_args);
+        }
+
+        case INTRINSIC_EXPECT:
+            return irb->CreateCall(Intrinsic::getDeclaration(llvm_module, Intrinsic::expect, { args[0]->getType() }), { args[0], args[1] });
+
+        case INTRINSIC_ASSUME:
+            return irb->CreateCall(Intrinsic::getDeclaration(llvm_module, Intrinsic::assume), { args[0] });
+
+        case INTRINSIC_NONTEMPORAL_STORE: {
+            auto store = irb->CreateStore(args[1], args[0]);
+            store->setMetadata(LLVMContext::MD_nontemporal, MDNode::get(*llvm_context, ConstantAsMetadata::get(irb->getInt32(1))));
+            return store;
+        }
+
+        case INTRINSIC_READCYCLECOUNTER:
+            return irb->CreateCall(Intrinsic::getDeclaration(llvm_module, Intrinsic::readcyclecounter));
+    }
+
+    assert(false);
+    return nullptr;
+}
+
+// Returns the function for uses other than calling it directly. Calls through function pointers always
+// use the C calling convention, so the function and its existing direct calls are switched back to that.
+Function *LLVM_Generator::get_function_address(Ast_Function *function) {
+    auto func = get_or_create_function(function);
+    if (func->getCallingConv() == CallingConv::C) return func;
+
+    func->setCallingConv(CallingConv::C);
+    for (auto user : func->users()) {
+        if (auto call = dyn_cast<CallInst>(user)) {
+            if (call->getCalledFunction() == func) call->setCallingConv(CallingConv::C);
+        }
+    }
+
+    return func;
+}
+
 void LLVM_Generator::emit_scope(Ast_Scope *scope) {
     auto old_di_scope = di_current_scope;
-    di_current_scope = dib->createLexicalBlock(old_di_scope, get_debug_file(llvm_context, scope), get_line_number(scope), 0);
+    if (dib) di_current_scope = dib->createLexicalBlock(old_di_scope, get_debug_file(llvm_context, scope), get_line_number(scope), 0);
+
+    bool emit_variable_debug_info = compiler->build_options.debug_info_level == DEBUG_INFO_FULL;
 
     auto current_block = irb->GetInsertBlock();
     auto func = current_block->getParent();
@@ -1915,10 +2874,10 @@ void LLVM_Generator::emit_scope(Ast_Scope *scope) {
             alloca->setName(string_ref(name));
         }
 
-        assert(get_value_for_decl(decl) == nullptr);
-        decl_value_map.add(MakeTuple(decl, alloca));
+        set_value_for_decl(decl, alloca);
 
         // debug info
+        if (!emit_variable_debug_info) continue;
 
         // @TODO this should be based on desired optimization. Though, in my experience,
         // even this flag doesn't help preserve the actual stack variable much on Windows
@@ -1970,7 +2929,7 @@ DISubroutineType *LLVM_Generator::get_debug_subroutine_type(Ast_Type_Info *type)
         //     }
         // }
 
-        if (is_aggregate_type(arg_type)) {
+        if (is_pass_by_pointer_argument(TargetMachine, type, arg_type)) {
             di_type = dib->createReferenceType(dwarf::DW_TAG_reference_type, di_type, TargetMachine->getPointerSizeInBits(0));
         }
 
@@ -1980,6 +2939,55 @@ DISubroutineType *LLVM_Generator::get_debug_subroutine_type(Ast_Type_Info *type)
     return dib->createSubroutineType(dib->getOrCreateTypeArray(ArrayRef<Metadata *>(arguments.data, arguments.count)));
 }
 
+static bool is_local_memory(Value *pointer) {
+    while (true) {
+        if (auto gep = dyn_cast<GEPOperator>(pointer)) {
+            pointer = gep->getPointerOperand();
+        } else if (auto cast = dyn_cast<BitCastOperator>(pointer)) {
+            pointer = cast->getOperand(0);
+        } else {
+            break;
+        }
+    }
+
+    return isa<AllocaInst>(pointer);
+}
+
+// Marks a function readnone or readonly when the only memory it writes, or touches at all,
+// is its own stack. Callees are only trusted once they have been marked themselves, so this
+// is conservative for functions emitted before the functions they call.
+static void infer_memory_attributes(Function *func) {
+    bool reads_memory = false;
+
+    for (auto &block : *func) {
+        for (auto &inst : block) {
+            if (auto call = dyn_cast<CallBase>(&inst)) {
+                auto callee = call->getCalledFunction();
+                if (!callee) return;
+
+                if (callee->doesNotAccessMemory()) continue;
+                if (!callee->onlyReadsMemory()) return;
+
+                reads_memory = true;
+            } else if (auto load = dyn_cast<LoadInst>(&inst)) {
+                if (load->isVolatile()) return;
+                if (!is_local_memory(load->getPointerOperand())) reads_memory = true;
+            } else if (auto store = dyn_cast<StoreInst>(&inst)) {
+                if (store->isVolatile()) return;
+                if (!is_local_memory(store->getPointerOperand())) return;
+            } else if (inst.mayReadOrWriteMemory()) {
+                return;
+            }
+        }
+    }
+
+    if (reads_memory) {
+        func->setOnlyReadsMemory();
+    } else {
+        func->setDoesNotAccessMemory();
+    }
+}
+
 void LLVM_Generator::emit_function(Ast_Function *function) {
     assert(function->identifier && function->identifier->name);
     if (!function->scope) return;
@@ -1987,8 +2995,6 @@ void LLVM_Generator::emit_function(Ast_Function *function) {
     Function *func = get_or_create_function(function);
 
     {
-        func->addFnAttr(Attribute::AttrKind::NoUnwind);
-
         // Unwind tables are necessary on Windows regardless if we support exceptions or not
         // in order for stack unwinding to work in debuggers, and probably for SEH too. This
         // doesnt seem to be necessary on Unix-style platforms. -josh 15 December 2019
@@ -2005,14 +3011,27 @@ void LLVM_Generator::emit_function(Ast_Function *function) {
         return;
     }
 
-    StringRef function_name = string_ref(function->identifier->name->name);
-    StringRef linkage_name  = string_ref(function->linkage_name);
-    auto subroutine_type    = get_debug_subroutine_type(get_type_info(function));
-    assert(di_current_scope);
-    auto di_subprogram      = dib->createFunction(di_current_scope, function_name, linkage_name,
+    bool emit_variable_debug_info = compiler->build_options.debug_info_level == DEBUG_INFO_FULL;
+
+    DISubprogram *di_subprogram = nullptr;
+    if (dib) {
+        StringRef function_name = string_ref(function->identifier->name->name);
+        StringRef linkage_name  = string_ref(function->linkage_name);
+
+        DISubroutineType *subroutine_type = nullptr;
+        if (emit_variable_debug_info) {
+            subroutine_type = get_debug_subroutine_type(get_type_info(function));
+        } else {
+            // Line tables don't describe types, an empty signature is all the subprogram needs.
+            subroutine_type = dib->createSubroutineType(dib->getOrCreateTypeArray(None));
+        }
+
+        assert(di_current_scope);
+        di_subprogram = dib->createFunction(di_current_scope, function_name, linkage_name,
                                             get_debug_file(llvm_context, function), get_line_number(function),
                                             subroutine_type, get_line_number(function->scope), DINode::FlagPrototyped, DISubprogram::SPFlagDefinition);
-    func->setSubprogram(di_subprogram);
+        func->setSubprogram(di_subprogram);
+    }
 
     auto old_di_scope = di_current_scope;
     di_current_scope = di_subprogram;
@@ -2024,17 +3043,24 @@ void LLVM_Generator::emit_function(Ast_Function *function) {
     irb->SetInsertPoint(entry);
     irb->SetCurrentDebugLocation(DebugLoc::get(get_line_number(function), 0, di_current_scope));
 
+    auto function_type = get_underlying_final_type(get_type_info(function));
+
     auto arg_it = func->arg_begin();
+    if (is_return_by_pointer_argument(TargetMachine, function_type)) {
+        // The caller reserves storage for the return value, return statements write straight into it.
+        return_pointer = arg_it;
+        arg_it++;
+    }
+
     for (array_count_type i = 0; i < function->arguments.count; ++i) {
         auto a  = arg_it;
 
         auto decl = function->arguments[i];
 
         Value *storage = nullptr;
-        if (is_aggregate_type(get_type_info(decl))) {
+        if (is_pass_by_pointer_argument(TargetMachine, function_type, get_type_info(decl))) {
             // Aggregate parameters are already references/pointers so we don't need storage for them.
-            assert(get_value_for_decl(decl) == nullptr);
-            decl_value_map.add(MakeTuple(decl, static_cast<Value *>(a)));
+            set_value_for_decl(decl, a);
 
             storage = a;
         } else {
@@ -2045,12 +3071,15 @@ void LLVM_Generator::emit_function(Ast_Function *function) {
             alloca->setAlignment(get_alignment(get_type_info(decl)));
             irb->CreateStore(a, alloca);
 
-            assert(get_value_for_decl(decl) == nullptr);
-            decl_value_map.add(MakeTuple<Ast_Declaration *, Value *>(decl, alloca));
+            set_value_for_decl(decl, alloca);
 
             storage = alloca;
         }
 
+        arg_it++;
+
+        if (!emit_variable_debug_info) continue;
+
         String name;
         if (decl->identifier) name = decl->identifier->name->name;
 
@@ -2061,8 +3090,6 @@ void LLVM_Generator::emit_function(Ast_Function *function) {
                             di_type, always_preserve);
         dib->insertDeclare(storage, param, DIExpression::get(*llvm_context, None), DebugLoc::get(get_line_number(decl), 0, di_subprogram),
                             starting_block);
-
-        arg_it++;
     }
 
     irb->CreateBr(starting_block);
@@ -2075,13 +3102,20 @@ void LLVM_Generator::emit_function(Ast_Function *function) {
     if (!current_block->getTerminator()) {
         auto return_type = function->return_type;
         // @Cleanup early out for void types since we use i8 for pointers
-        if (return_type && get_underlying_final_type(return_type->type_value)->type != Ast_Type_Info::VOID) {
+        if (return_pointer) {
+            create_store(Constant::getNullValue(get_type(return_type->type_value)), return_pointer, return_type->type_value);
+            irb->CreateRetVoid();
+        } else if (return_type && get_underlying_final_type(return_type->type_value)->type != Ast_Type_Info::VOID) {
             irb->CreateRet(Constant::getNullValue(get_type(return_type->type_value)));
         } else {
             irb->CreateRetVoid();
         }
     }
 
+    return_pointer = nullptr;
+
+    infer_memory_attributes(func);
+
     decl_value_map.clear();
     loop_header_map.clear();
     loop_exit_map.clear();
@@ -2115,6 +3149,101 @@ void LLVM_Generator::emit_global_variable(Ast_Declaration *decl) {
 
 #include <stdio.h>
 
+// Stores JIT-compiled objects in the cache directory, keyed on the module's unoptimized IR and everything
+// else that affects code generation, so an unchanged metaprogram skips optimization and codegen on its next run.
+struct Jit_Object_Cache : public ObjectCache {
+    String cache_directory;
+    std::string target_key; // LLVM version, triple, CPU, features and optimization level.
+
+    // The transform layer keys each module before optimizing it, and the path travels to
+    // getObject and notifyObjectCompiled as named metadata on the module.
+    const char *PATH_METADATA_NAME = "jiyu.jit_object_path";
+
+    // Returns the path of the cached object for _module_, which must not be optimized yet.
+    std::string assign_object_path(Module *module) {
+        std::string ir;
+        raw_string_ostream ir_stream(ir);
+        module->print(ir_stream, nullptr);
+        ir_stream.flush();
+
+        // The module identifier is not part of the code, skip it.
+        StringRef ir_ref = ir;
+        if (ir_ref.startswith("; ModuleID")) ir_ref = ir_ref.split('\n').second;
+
+        MD5 hash;
+        hash.update(ir_ref);
+        hash.update(target_key);
+
+        MD5::MD5Result result;
+        hash.final(result);
+
+        SmallString<32> digest;
+        MD5::stringifyResult(result, digest);
+
+        std::string path = std::string(cache_directory.data, cache_directory.length) + "/jit_" + digest.c_str() + ".o";
+
+        auto &context = module->getContext();
+        module->getOrInsertNamedMetadata(PATH_METADATA_NAME)->addOperand(MDNode::get(context, MDString::get(context, path)));
+        return path;
+    }
+
+    // A module that skipped the optimizer because its object was cached must not be stored if
+    // that object disappeared before it was loaded.
+    void mark_unoptimized(Module *module) {
+        auto &context = module->getContext();
+        module->getOrInsertNamedMetadata(PATH_METADATA_NAME)->addOperand(MDNode::get(context, MDString::get(context, "unoptimized")));
+    }
+
+    std::string get_object_path(const Module *module) {
+        auto node = module->getNamedMetadata(PATH_METADATA_NAME);
+        if (!node || node->getNumOperands() == 0) return std::string();
+
+        return cast<MDString>(node->getOperand(0)->getOperand(0))->getString().str();
+    }
+
+    std::unique_ptr<MemoryBuffer> getObject(const Module *module) override {
+        MICROPROFILE_SCOPEI("llvm", "jit_object_cache_lookup", -1);
+
+        std::string path = get_object_path(module);
+        if (path.empty()) return nullptr;
+
+        auto buffer = MemoryBuffer::getFile(path, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+        if (!buffer) return nullptr;
+
+        return std::move(*buffer);
+    }
+
+    void notifyObjectCompiled(const Module *module, MemoryBufferRef object) override {
+        std::string path = get_object_path(module);
+        if (path.empty()) return;
+
+        auto node = module->getNamedMetadata(PATH_METADATA_NAME);
+        if (node->getNumOperands() > 1) return; // See mark_unoptimized.
+
+        if (sys::fs::create_directories(string_ref(cache_directory))) return;
+
+        // Write to a unique temporary file and rename it into place, so concurrent
+        // metaprograms never load a partially written object.
+        SmallString<128> temp_path;
+        int fd;
+        if (sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temp_path)) return;
+
+        {
+            raw_fd_ostream out(fd, /*shouldClose=*/true);
+            out << object.getBuffer();
+            out.close();
+
+            if (out.has_error()) {
+                out.clear_error();
+                sys::fs::remove(temp_path);
+                return;
+            }
+        }
+
+        if (sys::fs::rename(temp_path, path)) sys::fs::remove(temp_path);
+    }
+};
+
 void LLVM_Jitter::init() {
     Triple target_triple  = llvm->TargetMachine->getTargetTriple();
     Triple process_triple = Triple(llvm::sys::getProcessTriple());
@@ -2170,13 +3299,27 @@ void LLVM_Jitter::init() {
         return;
     }
 
-    auto DL = JTMB->getDefaultDataLayoutForTarget();
-    if (!DL) {
-        DL.takeError();
+    {
+        // JIT code always runs on this machine, so use everything the host CPU supports unless told otherwise.
+        std::string CPU;
+        std::string Features;
+        get_target_cpu(&compiler->build_options, /*default_to_host=*/true, &CPU, &Features);
+
+        JTMB->setCPU(CPU);
+        JTMB->getFeatures() = SubtargetFeatures(Features);
+    }
+
+    auto data_layout = JTMB->getDefaultDataLayoutForTarget();
+    if (!data_layout) {
+        data_layout.takeError();
         return;
     }
 
+    // MangleAndInterner keeps a reference to the DataLayout, so it has to outlive it.
+    DL = new DataLayout(std::move(*data_layout));
+
     ES = new ExecutionSession();
+    Mangle = new MangleAndInterner(*ES, *DL);
     ObjectLayer = new RTDyldObjectLinkingLayer(*ES, []() { return llvm::make_unique<SectionMemoryManager>(); });
 
 #ifdef WIN32
@@ -2191,11 +3334,101 @@ void LLVM_Jitter::init() {
     ObjectLayer->setAutoClaimResponsibilityForObjectSymbols(true);
 #endif
 
-    CompileLayer = new IRCompileLayer(*ES, *ObjectLayer, ConcurrentIRCompiler(*JTMB));
+    s32 jit_optimization_level = compiler->build_options.jit_optimization_level;
+
+    if (jit_optimization_level > 0) {
+        CodeGenOpt::Level codegen_level = (jit_optimization_level == 1) ? CodeGenOpt::Less : CodeGenOpt::Default;
+        if (jit_optimization_level == 3) codegen_level = CodeGenOpt::Aggressive;
+
+        JTMB->setCodeGenOptLevel(codegen_level);
+
+        auto target_machine = JTMB->createTargetMachine();
+        if (target_machine) {
+            OptimizerTargetMachine = target_machine->release();
+        } else {
+            consumeError(target_machine.takeError());
+            jit_optimization_level = 0;
+        }
+    }
+
+    auto cache = new Jit_Object_Cache();
+    {
+        cache->cache_directory = compiler->build_options.cache_directory;
+
+        cache->target_key  = LLVM_VERSION_STRING;
+        cache->target_key += "|" + JTMB->getTargetTriple().str();
+        cache->target_key += "|" + JTMB->getCPU();
+        cache->target_key += "|" + JTMB->getFeatures().getString();
+        cache->target_key += "|" + std::to_string(jit_optimization_level);
+
+        JitObjectCache = cache;
+    }
+
+    CompileLayer = new IRCompileLayer(*ES, *ObjectLayer, ConcurrentIRCompiler(*JTMB, JitObjectCache));
+
+    TargetMachine *TM = OptimizerTargetMachine;
+
+    // The compile-on-demand layer hands us modules that contain the functions being compiled,
+    // so this effectively optimizes a function at a time, right before it is first called.
+    TransformLayer = new IRTransformLayer(*ES, *CompileLayer, [jit_optimization_level, TM, cache](ThreadSafeModule TSM, const MaterializationResponsibility &R) -> Expected<ThreadSafeModule> {
+        auto lock = TSM.getContext().getLock();
+        Module *module = TSM.getModule();
+
+        // The object cache is keyed on the IR before optimization, so a warm run skips the optimizer too.
+        std::string object_path = cache->assign_object_path(module);
+        if (jit_optimization_level == 0) return std::move(TSM);
+
+        if (sys::fs::exists(object_path)) {
+            cache->mark_unoptimized(module);
+            return std::move(TSM);
+        }
+
+        MICROPROFILE_SCOPEI("llvm", "jit_optimize", -1);
+
+        PassManagerBuilder builder;
+        builder.OptLevel = jit_optimization_level;
+        builder.SizeLevel = 0;
+        builder.LoopVectorize = (jit_optimization_level > 1);
+        builder.SLPVectorize  = (jit_optimization_level > 1);
+        TM->adjustPassManager(builder);
+
+        legacy::FunctionPassManager function_passes(module);
+        function_passes.add(createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+        builder.populateFunctionPassManager(function_passes);
+
+        legacy::PassManager module_passes;
+        module_passes.add(createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+        builder.populateModulePassManager(module_passes);
+
+        function_passes.doInitialization();
+        for (auto &func : *module) {
+            function_passes.run(func);
+        }
+        function_passes.doFinalization();
+
+        module_passes.run(*module);
+
+        return std::move(TSM);
+    });
+
+    {
+        // Compile functions lazily so metaprogram startup only pays for the code that actually runs,
+        // not for all the bindings in modules it imports.
+        auto call_through_manager = createLocalLazyCallThroughManager(JTMB->getTargetTriple(), *ES, /*ErrorHandlerAddr=*/0);
+        if (call_through_manager) {
+            CallThroughManager = call_through_manager->release();
+            CODLayer = new CompileOnDemandLayer(*ES, *TransformLayer, *CallThroughManager, createLocalIndirectStubsManagerBuilder(JTMB->getTargetTriple()));
+
+            // Each function is extracted into its own module when it is first called.
+            CODLayer->setPartitionFunction(CompileOnDemandLayer::compileRequested);
+        } else {
+            consumeError(call_through_manager.takeError());
+        }
+    }
 
     ES->getMainJITDylib().setGenerator(cantFail(DynamicLibrarySearchGenerator::GetForCurrentProcess(DL->getGlobalPrefix())));
 
-    llvm->dib->finalize();
+    if (llvm->dib) llvm->dib->finalize();
 
     llvm->llvm_module->setDataLayout(*DL);
     // llvm->llvm_module->dump();
@@ -2206,31 +3439,61 @@ void LLVM_Jitter::init() {
     pass.run(*llvm->llvm_module);
 #endif
 
-    cantFail(CompileLayer->add(ES->getMainJITDylib(),
-                              ThreadSafeModule(std::unique_ptr<Module>(llvm->llvm_module), *llvm->thread_safe_context)));
+    auto module = ThreadSafeModule(std::unique_ptr<Module>(llvm->llvm_module), *llvm->thread_safe_context);
+    if (CODLayer) {
+        cantFail(CODLayer->add(ES->getMainJITDylib(), std::move(module)));
+    } else {
+        cantFail(TransformLayer->add(ES->getMainJITDylib(), std::move(module)));
+    }
+}
+
+// Only exported symbols are visible to lookups, so that looking up one name or a batch of
+// names always resolves the same set of symbols.
+static JITDylibSearchList get_symbol_search_list(ExecutionSession *ES) {
+    return JITDylibSearchList({{&ES->getMainJITDylib(), false}});
 }
 
 void *LLVM_Jitter::lookup_symbol(String name) {
-    auto JTMB = JITTargetMachineBuilder::detectHost();
+    if (!ES) return nullptr;
 
-    if (!JTMB) {
-        JTMB.takeError();
+    auto sym = ES->lookup(get_symbol_search_list(ES), (*Mangle)(string_ref(name)));
+    if (!sym) {
+        consumeError(sym.takeError());
         return nullptr;
     }
+    return reinterpret_cast<void *>(sym->getAddress());
+}
 
-    auto DL = JTMB->getDefaultDataLayoutForTarget();
-    if (!DL) {
-        DL.takeError();
-        return nullptr;
+bool LLVM_Jitter::lookup_symbols(String *names, void **out_symbols, s64 count) {
+    if (!ES) return false;
+
+    SymbolNameSet symbol_names;
+    Array<SymbolStringPtr> mangled_names;
+    for (s64 i = 0; i < count; ++i) {
+        auto mangled = (*Mangle)(string_ref(names[i]));
+        symbol_names.insert(mangled);
+        mangled_names.add(mangled);
     }
 
-    // We're contructing a new MangleAndInterner every time because it seems if you re-use one that was allocated on the heap,
-    // sometimes it just crashes...
-    MangleAndInterner Mangle(*ES, *DL);
-    auto sym = ES->lookup({&ES->getMainJITDylib()}, Mangle(string_ref(name)));
-    if (!sym) {
-        sym.takeError();
-        return nullptr;
+    // A single lookup materializes everything the symbols need at once.
+    auto symbols = ES->lookup(get_symbol_search_list(ES), symbol_names);
+    if (!symbols) {
+        // The lookup fails as a whole if any symbol is missing, so resolve them one
+        // at a time to still hand back the ones that exist.
+        consumeError(symbols.takeError());
+
+        bool found_all = true;
+        for (s64 i = 0; i < count; ++i) {
+            out_symbols[i] = lookup_symbol(names[i]);
+            if (!out_symbols[i]) found_all = false;
+        }
+
+        return found_all;
     }
-    return reinterpret_cast<void *>(sym->getAddress());
+
+    for (s64 i = 0; i < count; ++i) {
+        out_symbols[i] = reinterpret_cast<void *>((*symbols)[mangled_names[i]].getAddress());
+    }
+
+    return true;
 }
@@ -9,6 +9,7 @@ namespace llvm {
     class LLVMContext;
 
     class Constant;
+    class GlobalVariable;
     class Value;
 
     class Type;
@@ -18,6 +19,8 @@ namespace llvm {
     class BasicBlock;
 
     class TargetMachine;
+    class DataLayout;
+    class ObjectCache;
     class ConstantFolder;
     class IRBuilderDefaultInserter;
     class DIBuilder;
@@ -33,6 +36,9 @@ namespace llvm {
         class ExecutionSession;
         class RTDyldObjectLinkingLayer;
         class IRCompileLayer;
+        class IRTransformLayer;
+        class CompileOnDemandLayer;
+        class LazyCallThroughManager;
         class ThreadSafeContext;
         class MangleAndInterner;
     }
@@ -44,7 +50,9 @@ struct Ast_Type_Info;
 struct Ast_Declaration;
 struct Ast_Scope;
 struct Ast_Expression;
+struct Loop_Hints;
 struct Ast_Literal;
+struct Ast_Function_Call;
 
 struct LLVM_Generator {
     Compiler *compiler;
@@ -57,7 +65,7 @@ struct LLVM_Generator {
     llvm::orc::ThreadSafeContext *thread_safe_context;
     llvm::IRBuilder<llvm::ConstantFolder, llvm::IRBuilderDefaultInserter> *irb;
 
-    llvm::DIBuilder *dib;
+    llvm::DIBuilder *dib; // Null at DEBUG_INFO_NONE. The di_type_ members are only set at DEBUG_INFO_FULL.
     llvm::DICompileUnit *di_compile_unit;
 
     llvm::Type *type_void;
@@ -93,17 +101,25 @@ struct LLVM_Generator {
     llvm::DIType *di_type_string_length;
     llvm::DIType *di_type_type;
 
+    // Storage for the locals of the function being emitted, indexed by Ast_Declaration::llvm_value_index.
     Array<Tuple<Ast_Declaration *, llvm::Value *>>     decl_value_map;
 
-    // Used for looking up the target BasicBlock for _continue_ and _break_. We probably want something more robust than this later on.
+    // Used for looking up the target BasicBlock for _continue_ and _break_. These are stacks of the loops and
+    // switches we are currently inside of, so the innermost, and usually targeted, statement is at the end.
     Array<Tuple<Ast_Expression *, llvm::BasicBlock *>> loop_header_map; // Jump target for _continue_
     Array<Tuple<Ast_Expression *, llvm::BasicBlock *>> loop_exit_map;    // Jump target for _break_
 
     llvm::DIScope *di_current_scope = nullptr;
 
+    // The caller-provided storage for the return value of the function being emitted, if it returns through a pointer argument.
+    llvm::Value *return_pointer = nullptr;
+
     Array<llvm::Type *> llvm_types;
     Array<llvm::DIType *> llvm_debug_types;
 
+    // Private constants that large, non-zero struct defaults are copied from, indexed by type_table_index.
+    Array<llvm::GlobalVariable *> default_initializer_globals;
+
 
     LLVM_Generator(Compiler *compiler) {
         this->compiler = compiler;
@@ -114,12 +130,18 @@ struct LLVM_Generator {
     void finalize();
 
     llvm::Value *create_string_literal(Ast_Literal *lit, bool want_lvalue = false);
+    llvm::Value *emit_string_equality(llvm::Value *left, llvm::Value *right);
+    void emit_bounds_check(llvm::Value *index, Ast_Type_Info *index_type, llvm::Value *count);
+    void emit_loop_hints(Loop_Hints *hints, llvm::BasicBlock *loop_entry, llvm::BasicBlock *loop_header);
     llvm::Value *get_value_for_decl(Ast_Declaration *decl);
+    void set_value_for_decl(Ast_Declaration *decl, llvm::Value *value);
     llvm::Value *dereference(llvm::Value *value, s64 element_path_index, bool is_lvalue = false);
     llvm::Constant *get_constant_struct_initializer(Ast_Type_Info *info);
     void default_init_struct(llvm::Value *decl_value, Ast_Type_Info *info);
+    void create_store(llvm::Value *value, llvm::Value *dest, Ast_Type_Info *info);
 
     llvm::Function *get_or_create_function(Ast_Function *function);
+    llvm::Function *get_function_address(Ast_Function *function);
     llvm::Type *get_type(Ast_Type_Info *type);
     llvm::Type *make_llvm_type(Ast_Type_Info *type);
     llvm::FunctionType *create_function_type(Ast_Function *function);
@@ -127,6 +149,7 @@ struct LLVM_Generator {
     void emit_function(Ast_Function *function);
     void emit_global_variable(Ast_Declaration *decl);
     llvm::Value *emit_expression(Ast_Expression *expression, bool is_lvalue = false);
+    llvm::Value *emit_intrinsic_call(Ast_Function_Call *call, Ast_Function *function);
 
     llvm::DISubroutineType *get_debug_subroutine_type(Ast_Type_Info *type);
     llvm::DIType           *get_debug_type(Ast_Type_Info *type);
@@ -142,11 +165,24 @@ struct LLVM_Jitter {
 
     Compiler *compiler;
     LLVM_Generator *llvm;
-    llvm::orc::ExecutionSession  *ES;
-    llvm::orc::MangleAndInterner *Mangle;
+    llvm::orc::ExecutionSession  *ES = nullptr;
+    llvm::orc::MangleAndInterner *Mangle = nullptr;
+    llvm::DataLayout             *DL = nullptr;
     llvm::orc::IRCompileLayer    *CompileLayer;
     llvm::orc::RTDyldObjectLinkingLayer *ObjectLayer;
 
+    // Optimizes IR before it reaches CompileLayer, see Build_Options::jit_optimization_level.
+    llvm::orc::IRTransformLayer *TransformLayer = nullptr;
+    llvm::TargetMachine         *OptimizerTargetMachine = nullptr;
+
+    // Reuses objects compiled by previous runs of the same metaprogram.
+    llvm::ObjectCache *JitObjectCache = nullptr;
+
+    // Functions are compiled the first time they are called. These are null if
+    // the host does not support lazy compilation, then everything is compiled up front.
+    llvm::orc::CompileOnDemandLayer   *CODLayer = nullptr;
+    llvm::orc::LazyCallThroughManager *CallThroughManager = nullptr;
+
     LLVM_Jitter(LLVM_Generator *_llvm) {
         this->llvm     = _llvm;
         this->compiler = _llvm->compiler;
@@ -154,6 +190,10 @@ struct LLVM_Jitter {
 
     void init();
     void *lookup_symbol(String name);
+
+    // Fills _out_symbols_ with the addresses of _names_, null for symbols that are not found.
+    // Returns true if every symbol was found.
+    bool lookup_symbols(String *names, void **out_symbols, s64 count);
 };
 
 
@@ -48,6 +48,15 @@ int main(int argc, char **argv) {
     String target_triple;
     char *import_c_file = nullptr;
     bool emit_llvm_ir = false;
+    s32  optimization_level = 0;
+    bool optimize_for_size  = false;
+    bool fast_debug = false;
+    s32  lto_mode   = LTO_NONE;
+    s32  debug_info_level = DEBUG_INFO_FULL;
+    bool split_debug_info = false;
+    bool bounds_check = false;
+    String cpu_name;
+    String cpu_features;
     Array<String> preload_definitions;
 
     int metaprogram_arg_start = -1;
@@ -61,6 +70,47 @@ int main(int argc, char **argv) {
             only_want_obj_file = true;
         } else if (to_string("-emit-llvm") == to_string(argv[i])) {
             emit_llvm_ir = true;
+        } else if (to_string("-O0") == to_string(argv[i])) {
+            optimization_level = 0;
+            optimize_for_size  = false;
+        } else if (to_string("-O1") == to_string(argv[i])) {
+            optimization_level = 1;
+            optimize_for_size  = false;
+        } else if (to_string("-O2") == to_string(argv[i])) {
+            optimization_level = 2;
+            optimize_for_size  = false;
+        } else if (to_string("-O3") == to_string(argv[i])) {
+            optimization_level = 3;
+            optimize_for_size  = false;
+        } else if (to_string("-Os") == to_string(argv[i])) {
+            optimization_level = 2;
+            optimize_for_size  = true;
+        } else if (to_string("-fast-debug") == to_string(argv[i])) {
+            fast_debug = true;
+        } else if (to_string("-flto") == to_string(argv[i]) || to_string("-flto=full") == to_string(argv[i])) {
+            lto_mode = LTO_FULL;
+        } else if (to_string("-flto=thin") == to_string(argv[i])) {
+            lto_mode = LTO_THIN;
+        } else if (to_string("-g0") == to_string(argv[i])) {
+            debug_info_level = DEBUG_INFO_NONE;
+        } else if (to_string("-gline-tables-only") == to_string(argv[i])) {
+            debug_info_level = DEBUG_INFO_LINE_TABLES;
+        } else if (to_string("-g") == to_string(argv[i])) {
+            debug_info_level = DEBUG_INFO_FULL;
+        } else if (to_string("-gsplit-dwarf") == to_string(argv[i])) {
+            split_debug_info = true;
+        } else if (to_string("-bounds-check") == to_string(argv[i])) {
+            bounds_check = true;
+        } else if (starts_with(to_string(argv[i]), to_string("-mcpu="))) {
+            cpu_name = to_string(argv[i]);
+            advance(&cpu_name, 6);
+        } else if (starts_with(to_string(argv[i]), to_string("-march="))) {
+            // Like clang on x86, -march selects the CPU. -march=native also enables all host features.
+            cpu_name = to_string(argv[i]);
+            advance(&cpu_name, 7);
+        } else if (starts_with(to_string(argv[i]), to_string("-mattr="))) {
+            cpu_features = to_string(argv[i]);
+            advance(&cpu_features, 7);
         } else if (to_string("-o") == to_string(argv[i])) {
             if (i+1 < argc) {
                 output_name = to_string(argv[i+1]);
@@ -121,6 +171,15 @@ int main(int argc, char **argv) {
     options.only_want_obj_file  = only_want_obj_file;
     options.verbose_diagnostics = verbose;
     options.emit_llvm_ir        = emit_llvm_ir;
+    options.optimization_level  = optimization_level;
+    options.optimize_for_size   = optimize_for_size;
+    options.fast_debug          = fast_debug;
+    options.lto_mode            = lto_mode;
+    options.debug_info_level    = debug_info_level;
+    options.split_debug_info    = split_debug_info;
+    options.bounds_check        = bounds_check;
+    options.cpu_name            = cpu_name;
+    options.cpu_features        = cpu_features;
 
     // Start profiling.
     MicroProfileOnThreadCreate("Main");
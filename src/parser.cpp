@@ -105,6 +105,10 @@ String token_type_to_string(Token::Type type) {
         case Token::TAG_META:       return copy_string(to_string("@metaprogram"));
         case Token::TAG_EXPORT:     return copy_string(to_string("@export"));
         case Token::TAG_FLAGS:      return copy_string(to_string("@flags"));
+        case Token::TAG_INLINE:     return copy_string(to_string("@inline"));
+        case Token::TAG_NOINLINE:   return copy_string(to_string("@noinline"));
+        case Token::TAG_COLD:       return copy_string(to_string("@cold"));
+        case Token::TAG_HOT:        return copy_string(to_string("@hot"));
 
         case Token::TEMPORARY_KEYWORD_C_VARARGS: return copy_string(to_string("temporary_c_vararg"));
 
@@ -1076,6 +1080,8 @@ Ast_Expression *Parser::parse_statement() {
         Ast_For *_for = PARSER_NEW(Ast_For);
         next_token();
 
+        if (!parse_loop_hints(&_for->hints)) return nullptr;
+
         token = peek_token();
         if (token->type == Token::STAR) {
             next_token();
@@ -1169,6 +1175,8 @@ Ast_Expression *Parser::parse_statement() {
         Ast_While *loop = PARSER_NEW(Ast_While);
         next_token();
 
+        if (!parse_loop_hints(&loop->hints)) return nullptr;
+
         loop->condition = parse_expression();
 
         if (!loop->condition) {
@@ -1608,6 +1616,29 @@ Ast_Type_Instantiation *Parser::parse_primary_type_inst() {
         return type_inst;
     }
 
+    if (token->type == Token::IDENTIFIER && token->string == to_string("vec") && lexer->tokens[current_token+1].type == Token::LEFT_PAREN) {
+        Ast_Type_Instantiation *type_inst = PARSER_NEW(Ast_Type_Instantiation);
+        next_token();
+        next_token();
+
+        type_inst->vector_element_type = parse_type_inst();
+        if (!type_inst->vector_element_type) {
+            compiler->report_error(type_inst, "Couldn't parse vector element type.\n");
+            return nullptr;
+        }
+
+        if (!expect_and_eat(Token::COMMA)) return nullptr;
+
+        type_inst->vector_width_expression = parse_expression();
+        if (!type_inst->vector_width_expression) {
+            compiler->report_error(type_inst, "Expected expression for vector width.\n");
+            return nullptr;
+        }
+
+        if (!expect_and_eat(Token::RIGHT_PAREN)) return nullptr;
+        return type_inst;
+    }
+
     if (token->type == Token::IDENTIFIER) {
         Ast_Type_Instantiation *type_inst = PARSER_NEW(Ast_Type_Instantiation);
 
@@ -1694,6 +1725,12 @@ Ast_Type_Instantiation *Parser::parse_primary_type_inst() {
         return nullptr;
     }
 
+    if (token->type == Token::TAG_INLINE || token->type == Token::TAG_NOINLINE || token->type == Token::TAG_COLD || token->type == Token::TAG_HOT) {
+        String name = token_type_to_string(token->type);
+        compiler->report_error(token, "%.*s tag is not valid for function types.", PRINT_ARG(name));
+        return nullptr;
+    }
+
     if (token->type == Token::LEFT_PAREN) {
         Ast_Type_Instantiation *final_type_inst = PARSER_NEW(Ast_Type_Instantiation);
         next_token();
@@ -1780,10 +1817,59 @@ Ast_Type_Instantiation *Parser::parse_primary_type_inst() {
     return nullptr;
 }
 
+// Parses the directives that may follow _for_ and _while_:
+// for #unroll(4) #vectorize #assume_no_alias array { }
+bool Parser::parse_loop_hints(Loop_Hints *hints) {
+    while (peek_token()->type == '#') {
+        next_token();
+
+        Token *token = peek_token();
+        if (!expect_and_eat(Token::IDENTIFIER)) return false;
+
+        if (token->string == to_string("assume_no_alias")) {
+            hints->assume_no_alias = true;
+            continue;
+        }
+
+        s64 *value = nullptr;
+        if (token->string == to_string("unroll")) {
+            value = &hints->unroll_count;
+        } else if (token->string == to_string("vectorize")) {
+            value = &hints->vectorize_width;
+        } else {
+            String s = token->string;
+            compiler->report_error(token, "Unknown loop directive '%.*s'.\n", PRINT_ARG(s));
+            return false;
+        }
+
+        *value = 0;
+
+        if (peek_token()->type == Token::LEFT_PAREN) {
+            next_token();
+
+            token = peek_token();
+            if (!expect_and_eat(Token::INTEGER)) return false;
+
+            if (token->integer < 1) {
+                compiler->report_error(token, "Loop directive argument must be greater than zero.\n");
+                return false;
+            }
+
+            *value = token->integer;
+
+            if (!expect_and_eat(Token::RIGHT_PAREN)) return false;
+        }
+    }
+
+    return true;
+}
+
 bool is_tag_token(Token *token) {
     auto type = token->type;
     return type == Token::TAG_C_FUNCTION || type == Token::TAG_META
-        || type == Token::TAG_EXPORT || type == Token::TAG_FLAGS;
+        || type == Token::TAG_EXPORT || type == Token::TAG_FLAGS
+        || type == Token::TAG_INLINE || type == Token::TAG_NOINLINE
+        || type == Token::TAG_COLD   || type == Token::TAG_HOT;
 }
 
 Ast_Function *Parser::parse_function() {
@@ -1844,6 +1930,22 @@ Ast_Function *Parser::parse_function() {
         } else if (token->type == Token::TAG_FLAGS) {
             compiler->report_error(token, "@flags tag is not valid for function types.");
             next_token();
+        } else if (token->type == Token::TAG_INLINE) {
+            if (function->is_marked_noinline) compiler->report_error(token, "@inline and @noinline may not be used together.\n");
+            function->is_marked_inline = true;
+            next_token();
+        } else if (token->type == Token::TAG_NOINLINE) {
+            if (function->is_marked_inline) compiler->report_error(token, "@inline and @noinline may not be used together.\n");
+            function->is_marked_noinline = true;
+            next_token();
+        } else if (token->type == Token::TAG_COLD) {
+            if (function->is_marked_hot) compiler->report_error(token, "@hot and @cold may not be used together.\n");
+            function->is_marked_cold = true;
+            next_token();
+        } else if (token->type == Token::TAG_HOT) {
+            if (function->is_marked_cold) compiler->report_error(token, "@hot and @cold may not be used together.\n");
+            function->is_marked_hot = true;
+            next_token();
         }
 
         token = peek_token();
@@ -65,6 +65,7 @@ struct Parser {
     void parse_enum_scope(Ast_Scope *scope);
     
     Ast_Function *parse_function();
+    bool parse_loop_hints(Loop_Hints *hints);
 
     bool add_declaration(Array<Ast_Scope_Entry *> *declarations, Ast_Scope_Entry *decl);
 };
@@ -4,6 +4,7 @@
 #include "compiler.h"
 #include "copier.h"
 #include "llvm.h"
+#include "clang_import.h"
 
 #include <stdio.h>
 #include <new> // for placement new
@@ -76,6 +77,12 @@ static void add_type(String_Builder *builder, Ast_Type_Info *type) {
         }
 
 
+        builder->putchar('_');
+        add_type(builder, type->array_element);
+        builder->putchar('_');
+    } else if (type->type == Ast_Type_Info::VECTOR) {
+        builder->putchar('V');
+        builder->print("%d", type->array_element_count);
         builder->putchar('_');
         add_type(builder, type->array_element);
         builder->putchar('_');
@@ -158,7 +165,7 @@ String get_mangled_name(Compiler *compiler, Ast_Function *function) {
 
     // Intrinsics will not implicitly create linkage symbols... at least for now,
     // so we can just return the identifier.
-    if (function->is_intrinsic) return function->identifier->name->name;
+    if (function->intrinsic_kind != INTRINSIC_NONE) return function->identifier->name->name;
 
     String_Builder builder;
 
@@ -298,6 +305,13 @@ void print_type_to_builder(String_Builder *builder, Ast_Type_Info *info) {
         return;
     }
 
+    if (info->type == Ast_Type_Info::VECTOR) {
+        builder->print("vec(");
+        print_type_to_builder(builder, info->array_element);
+        builder->print(", %d)", info->array_element_count);
+        return;
+    }
+
     if (info->type == Ast_Type_Info::STRUCT) {
         if (info->is_tuple) {
             builder->append("Tuple");
@@ -479,6 +493,9 @@ u64 maybe_mutate_literal_to_type(Ast_Literal *lit, Ast_Type_Info *target_type) {
     target_type = get_final_type(target_type);
     assert(target_type != nullptr);
 
+    // Scalar literals used as vectors take on the element type and are splatted afterwards.
+    if (target_type->type == Ast_Type_Info::VECTOR) target_type = target_type->array_element;
+
     u64 viability_score = 0;
     if (lit->literal_type == Ast_Literal::INTEGER) {
         if (is_int_or_enum_type(target_type) || is_float_type(target_type)) {
@@ -564,6 +581,18 @@ u64 maybe_mutate_literal_to_type(Ast_Literal *lit, Ast_Type_Info *target_type) {
 const u32 ALLOW_COERCE_TO_PTR_VOID = (1 << 0);
 const u32 ALLOW_COERCE_TO_BOOL     = (1 << 1);
 
+Ast_Expression *Sema::splat_scalar_to_vector(Ast_Expression *scalar, Ast_Type_Info *vector_type) {
+    auto element = get_underlying_final_type(vector_type)->array_element;
+
+    auto result = typecheck_and_implicit_cast_single_expression(scalar, element, 0);
+    if (compiler->errors_reported) return nullptr;
+
+    auto element_expression = result.item2;
+    if (!types_match(get_type_info(element_expression), element)) return nullptr;
+
+    return cast_scalar_to_vector(compiler, element_expression, vector_type);
+}
+
 Tuple<u64, Ast_Expression *> Sema::typecheck_and_implicit_cast_single_expression(Ast_Expression *expression, Ast_Type_Info *target_type_info, u32 allow_flags) {
     typecheck_expression(expression, target_type_info);
 
@@ -636,6 +665,11 @@ Tuple<u64, Ast_Expression *> Sema::typecheck_and_implicit_cast_single_expression
         } else if (is_float_type(ltype) && is_int_type(rtype)) {
             right = cast_int_to_float(compiler, right, ltype);
             viability_score += 10;
+        } else if (is_vector_type(ltype) && (is_int_type(rtype) || is_float_type(rtype))) {
+            if (auto splat = splat_scalar_to_vector(right, ltype)) {
+                right = splat;
+                viability_score += 1;
+            }
         } else if (is_pointer_type(ltype) && is_pointer_type(rtype)) {
 
             auto left_indir = get_levels_of_indirection(ltype);
@@ -1154,6 +1188,16 @@ Tuple<u64, u64> Sema::typecheck_and_implicit_cast_expression_pair(Ast_Expression
         } else if (is_int_type(ltype) && is_float_type(rtype)) {
             left = cast_int_to_float(compiler, left, rtype);
             left_viability_score += 10;
+        } else if (is_vector_type(ltype) && (is_int_type(rtype) || is_float_type(rtype))) {
+            if (auto splat = splat_scalar_to_vector(right, ltype)) {
+                right = splat;
+                right_viability_score += 1;
+            }
+        } else if (is_vector_type(rtype) && (is_int_type(ltype) || is_float_type(ltype))) {
+            if (auto splat = splat_scalar_to_vector(left, rtype)) {
+                left = splat;
+                left_viability_score += 1;
+            }
         } else if (allow_coerce_to_ptr_void && is_pointer_type(ltype) && is_pointer_type(rtype)) {
 
             // @Note you're only allowed to coerce right-to-left here, meaning if the right-expression is *void,
@@ -1176,6 +1220,90 @@ Tuple<u64, u64> Sema::typecheck_and_implicit_cast_expression_pair(Ast_Expression
     return MakeTuple(left_viability_score, right_viability_score);
 }
 
+void Sema::typecheck_vector_builtin_call(Ast_Function_Call *call, Atom *name) {
+    for (auto arg: call->argument_list) {
+        typecheck_expression(arg);
+        if (compiler->errors_reported) return;
+    }
+
+    auto builtin = SEMA_NEW(Ast_Vector_Builtin);
+    copy_location_info(builtin, call);
+
+    String builtin_name = name->name;
+
+    if (name == compiler->atom_builtin_shuffle) {
+        builtin->builtin_kind = Ast_Vector_Builtin::SHUFFLE;
+
+        if (call->argument_list.count < 3) {
+            compiler->report_error(call, "__builtin_shuffle expects two vectors followed by at least one lane index.\n");
+            return;
+        }
+
+        auto first  = call->argument_list[0];
+        auto second = call->argument_list[1];
+
+        auto vector_type = get_type_info(first);
+        if (!is_vector_type(vector_type)) {
+            compiler->report_error(first, "First argument to __builtin_shuffle must be a vector.\n");
+            return;
+        }
+
+        if (!types_match(vector_type, get_type_info(second))) {
+            compiler->report_error(second, "Both vector arguments to __builtin_shuffle must be of the same type.\n");
+            return;
+        }
+
+        vector_type = get_underlying_final_type(vector_type);
+
+        for (array_count_type i = 2; i < call->argument_list.count; ++i) {
+            auto index = call->argument_list[i];
+
+            auto lit = folds_to_literal(index);
+            if (compiler->errors_reported) return;
+
+            if (!lit || !is_int_type(get_type_info(lit))) {
+                compiler->report_error(index, "Lane indices of __builtin_shuffle must resolve to integer literals.\n");
+                return;
+            }
+
+            auto value = lit->integer_value;
+            if (value < 0 || value >= vector_type->array_element_count * 2) {
+                compiler->report_error(index, "Lane index %lld is out of range for two vectors of width %lld.\n", value, vector_type->array_element_count);
+                return;
+            }
+
+            builtin->shuffle_mask.add(value);
+        }
+
+        builtin->arguments.add(first);
+        builtin->arguments.add(second);
+        builtin->type_info = compiler->make_vector_type(vector_type->array_element, builtin->shuffle_mask.count);
+    } else {
+        if (name == compiler->atom_builtin_reduce_add) builtin->builtin_kind = Ast_Vector_Builtin::REDUCE_ADD;
+        else if (name == compiler->atom_builtin_reduce_mul) builtin->builtin_kind = Ast_Vector_Builtin::REDUCE_MUL;
+        else if (name == compiler->atom_builtin_reduce_min) builtin->builtin_kind = Ast_Vector_Builtin::REDUCE_MIN;
+        else if (name == compiler->atom_builtin_reduce_max) builtin->builtin_kind = Ast_Vector_Builtin::REDUCE_MAX;
+        else assert(false);
+
+        if (call->argument_list.count != 1) {
+            compiler->report_error(call, "%.*s expects exactly one vector argument.\n", PRINT_ARG(builtin_name));
+            return;
+        }
+
+        auto vector = call->argument_list[0];
+        auto vector_type = get_type_info(vector);
+        if (!is_vector_type(vector_type)) {
+            compiler->report_error(vector, "Argument to %.*s must be a vector.\n", PRINT_ARG(builtin_name));
+            return;
+        }
+
+        builtin->arguments.add(vector);
+        builtin->type_info = get_underlying_final_type(vector_type)->array_element;
+    }
+
+    call->substitution = builtin;
+}
+
 void Sema::typecheck_scope(Ast_Scope *scope) {
     assert(scope->substitution == nullptr);
 
@@ -1420,6 +1548,8 @@ Tuple<bool, u64> Sema::function_call_is_viable(Ast_Function_Call *call, Ast_Type
 
 void Sema::collect_function_overloads_for_atom_in_scope(Atom *atom, Ast_Scope *start, Array<Ast_Function *> *overload_set, bool check_private_declarations) {
     assert(start->rejected_by_static_if == false);
+    if (start->lazy_c_imports) materialize_clang_declarations(compiler, start, atom);
+
     for (auto it : start->declarations) {
         assert(it->substitution == nullptr);
         // while (it->substitution) it = it->substitution;
@@ -1454,6 +1584,8 @@ void Sema::collect_function_overloads_for_atom(Atom *atom, Ast_Scope *start, Arr
 
 Ast_Expression *Sema::find_declaration_for_atom_in_scope(Ast_Scope *scope, Atom *atom, bool check_private_declarations) {
     // @Incomplete check scope tree
+    if (scope->lazy_c_imports) materialize_clang_declarations(compiler, scope, atom);
+
     for (auto it : scope->declarations) {
         assert(it->substitution == nullptr);
         // while (it->substitution) it = it->substitution;
@@ -1587,6 +1719,12 @@ void Sema::resolve_identifier(Ast_Identifier *ident, bool overload_set_allowed,
             } else {
                 assert(ident->overload_set.count == 1);
 
+                if (static_cast<Ast_Function *>(decl)->intrinsic_kind != INTRINSIC_NONE) {
+                    String name = ident->name->name;
+                    compiler->report_error(ident, "Intrinsic '%.*s' can only be called, it does not have an address.\n", PRINT_ARG(name));
+                    return;
+                }
+
                 typecheck_expression(decl);
                 ident->resolved_declaration = decl;
                 ident->type_info = get_type_info(decl);
@@ -2011,6 +2149,20 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                 return;
             }
 
+            if (is_vector_type(left_type)) {
+                if (bin->operator_type == Token::EQ_OP ||
+                    bin->operator_type == Token::NE_OP ||
+                    bin->operator_type == Token::LE_OP ||
+                    bin->operator_type == Token::GE_OP ||
+                    bin->operator_type == Token::RIGHT_ANGLE ||
+                    bin->operator_type == Token::LEFT_ANGLE) {
+                    compiler->report_error(bin, "Comparison operators are not valid for vector operands.\n");
+                    return;
+                }
+
+                left_type = get_scalar_type(left_type);
+            }
+
             // IC: I think it's more clear to check the operators for each type independently.
             if (is_enum_type(left_type)) {
                 if (bin->operator_type == Token::SLASH ||
@@ -2092,34 +2244,6 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                 }
             }
 
-            if ((bin->operator_type == Token::EQ_OP) || (bin->operator_type == Token::NE_OP)) {
-                if (left_type->type == Ast_Type_Info::STRING) {
-                    Ast_Function_Call *call = SEMA_NEW(Ast_Function_Call);
-                    copy_location_info(call, bin);
-
-                    auto identifier = make_identifier(compiler, compiler->atom___strings_match);
-                    copy_location_info(identifier, bin);
-                    identifier->enclosing_scope = compiler->global_scope;
-
-                    call->function_or_function_ptr = identifier;
-                    call->argument_list.add(bin->left);
-                    call->argument_list.add(bin->right);
-
-                    typecheck_expression(call);
-                    bin->substitution = call;
-
-                    if (bin->operator_type == Token::NE_OP) {
-                        auto _not = make_binary(compiler, Token::NE_OP, call, make_bool_literal(compiler, true, /*location=*/bin), /*location=*/bin);
-
-                        // @Speed we can probably just assign _not->type_info to compiler->type_bool.
-                        typecheck_expression(_not);
-
-                        bin->substitution = _not;
-                    }
-                    return;
-                }
-            }
-
             return;
         }
 
@@ -2156,7 +2280,8 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                 un->type_info = type->pointer_to;
             } else if (un->operator_type == Token::MINUS) {
                 auto type = get_type_info(un->expression);
-                if (!is_int_type(type) && !is_float_type(type)) {
+                auto scalar_type = get_scalar_type(type);
+                if (!is_int_type(scalar_type) && !is_float_type(scalar_type)) {
                     compiler->report_error(un, "Unary '-' is only valid for integer for float operands.\n");
                     return;
                 }
@@ -2179,7 +2304,8 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                 un->type_info = compiler->type_bool;
             } else if (un->operator_type == Token::TILDE) {
                 auto type = get_type_info(un->expression);
-                if (!is_int_type(type)) {
+                auto scalar_type = get_scalar_type(type);
+                if (!is_int_type(scalar_type)) {
                     compiler->report_error(un, "Unary '~' is only valid for integer operands.\n");
                     return;
                 }
@@ -2252,6 +2378,15 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                     call->substitution = os;
                     return;
                 }
+
+                if (identifier->name == compiler->atom_builtin_shuffle    ||
+                    identifier->name == compiler->atom_builtin_reduce_add ||
+                    identifier->name == compiler->atom_builtin_reduce_mul ||
+                    identifier->name == compiler->atom_builtin_reduce_min ||
+                    identifier->name == compiler->atom_builtin_reduce_max) {
+                    typecheck_vector_builtin_call(call, identifier->name);
+                    return;
+                }
             }
 
             typecheck_expression(subexpression, want_numeric_type, true);
@@ -2321,6 +2456,22 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
 
                     identifier->resolved_declaration = function;
                     identifier->type_info = function->type_info;
+
+                    if (function->intrinsic_kind == INTRINSIC_PREFETCH) {
+                        // LLVM requires these to be immediates.
+                        auto write    = folds_to_literal(call->argument_list[1]);
+                        auto locality = folds_to_literal(call->argument_list[2]);
+
+                        if (!write || !locality) {
+                            compiler->report_error(call, "The write and locality arguments to __builtin_prefetch must be literal values.\n");
+                            return;
+                        }
+
+                        if (locality->integer_value < 0 || locality->integer_value > 3) {
+                            compiler->report_error(call->argument_list[2], "Prefetch locality must be in the range 0 to 3.\n");
+                            return;
+                        }
+                    }
                     return;
                 }
             }
@@ -2416,10 +2567,11 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                 left_type = get_final_type(left_type);
                 if (left_type->type != Ast_Type_Info::STRING &&
                     left_type->type != Ast_Type_Info::ARRAY  &&
+                    left_type->type != Ast_Type_Info::VECTOR &&
                     left_type->type != Ast_Type_Info::STRUCT &&
                     left_type->type != Ast_Type_Info::ENUM) {
                     String given = type_to_string(left_type);
-                    compiler->report_error(deref, "Attempt to dereference a type that is not a string, struct, array, or enum! (Given %.*s)\n", PRINT_ARG(given));
+                    compiler->report_error(deref, "Attempt to dereference a type that is not a string, struct, array, vector, or enum! (Given %.*s)\n", PRINT_ARG(given));
                     free(given.data);
                     return;
                 }
@@ -2507,6 +2659,65 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                         compiler->report_error(deref, "No member '%.*s' in known-size array.\n", field_name.length, field_name.data);
                     }
                 }
+            } else if (left_type->type == Ast_Type_Info::VECTOR) {
+                auto builtin = SEMA_NEW(Ast_Vector_Builtin);
+                copy_location_info(builtin, deref);
+                builtin->builtin_kind = Ast_Vector_Builtin::SHUFFLE;
+
+                // Swizzles use either xyzw or rgba, but not a mix of both.
+                String field_name = field_atom->name;
+                const char *component_sets[] = { "xyzw", "rgba" };
+
+                bool valid = field_name.length >= 1 && field_name.length <= 4 && !deref->is_type_dereference;
+                if (valid) {
+                    valid = false;
+                    for (auto set: component_sets) {
+                        builtin->shuffle_mask.clear();
+
+                        for (string_length_type i = 0; i < field_name.length; ++i) {
+                            auto found = strchr(set, field_name.data[i]);
+                            if (!found || (found - set) >= left_type->array_element_count) break;
+
+                            builtin->shuffle_mask.add(found - set);
+                        }
+
+                        if (builtin->shuffle_mask.count == field_name.length) {
+                            valid = true;
+                            break;
+                        }
+                    }
+                }
+
+                if (!valid) {
+                    String given = type_to_string(left_type);
+                    compiler->report_error(deref, "No member '%.*s' in type %.*s. Vectors only have swizzle members made of x, y, z, w or r, g, b, a.\n", PRINT_ARG(field_name), PRINT_ARG(given));
+                    free(given.data);
+                    return;
+                }
+
+                Ast_Expression *vector_expression = deref->left;
+                if (is_pointer_type(get_type_info(deref->left))) {
+                    vector_expression = make_unary(compiler, Token::DEREFERENCE_OR_SHIFT, deref->left);
+                    copy_location_info(vector_expression, deref);
+                }
+
+                if (builtin->shuffle_mask.count == 1) {
+                    // A single component stays an lvalue, so v.x = 1 works.
+                    auto lit = make_integer_literal(compiler, builtin->shuffle_mask[0], compiler->type_array_count, deref);
+                    auto index = make_array_index(compiler, vector_expression, lit);
+                    copy_location_info(index, deref);
+
+                    typecheck_expression(index);
+                    deref->substitution = index;
+                    return;
+                }
+
+                typecheck_expression(vector_expression);
+                if (compiler->errors_reported) return;
+
+                builtin->arguments.add(vector_expression);
+                builtin->type_info = compiler->make_vector_type(left_type->array_element, builtin->shuffle_mask.count);
+                deref->substitution = builtin;
             } else if (left_type->type == Ast_Type_Info::STRUCT) {
                 // @Hack if clang_import has imported a struct and jiyu code uses a field of that struct
                 // sometimes the struct has not be typechecked at this point, but we have an Ast_Type_Info node,
@@ -2926,6 +3137,19 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                 return;
             }
 
+            if (is_vector_type(target) && !is_vector_type(expr_type)) {
+                // Splat: convert the scalar to the element type first so codegen only has to broadcast it.
+                auto element = get_underlying_final_type(target)->array_element;
+                if (!types_match(expr_type, element)) {
+                    Ast_Cast *element_cast = SEMA_NEW(Ast_Cast);
+                    copy_location_info(element_cast, cast);
+                    element_cast->expression = cast->expression;
+                    element_cast->type_info = element;
+
+                    cast->expression = element_cast;
+                }
+            }
+
             return;
         }
 
@@ -3226,8 +3450,8 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
             array_type = get_final_type(array_type);
 
             if (array_type->type != Ast_Type_Info::ARRAY   && array_type->type != Ast_Type_Info::POINTER &&
-                array_type->type != Ast_Type_Info::STRING) {
-                compiler->report_error(deref->array_or_pointer_expression, "Expected array, string, or pointer for index expression, but got something else.\n");
+                array_type->type != Ast_Type_Info::STRING  && array_type->type != Ast_Type_Info::VECTOR) {
+                compiler->report_error(deref->array_or_pointer_expression, "Expected array, string, vector, or pointer for index expression, but got something else.\n");
                 return;
             }
 
@@ -3237,7 +3461,7 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
                 return;
             }
 
-            if (array_type->type == Ast_Type_Info::ARRAY &&
+            if ((array_type->type == Ast_Type_Info::ARRAY || array_type->type == Ast_Type_Info::VECTOR) &&
                 array_type->array_element_count >= 0) {
                 auto lit = resolves_to_literal_value(deref->index_expression);
                 if (lit) {
@@ -3258,6 +3482,7 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
             }
 
             if (array_type->type == Ast_Type_Info::ARRAY) deref->type_info = array_type->array_element;
+            else if (array_type->type == Ast_Type_Info::VECTOR) deref->type_info = array_type->array_element;
             else if (array_type->type == Ast_Type_Info::POINTER) deref->type_info = array_type->pointer_to;
             else if (array_type->type == Ast_Type_Info::STRING) deref->type_info = compiler->type_uint8;
             else assert(false);
@@ -3315,6 +3540,11 @@ void Sema::typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_
             typeof->type_info = compiler->type_info_type;
             return;
         }
+        case AST_VECTOR_BUILTIN: {
+            // These are only created by Sema, already typechecked.
+            assert(false);
+            return;
+        }
         case AST_OS: {
             auto os = static_cast<Ast_Os *>(expression);
 
@@ -3933,6 +4163,42 @@ Ast_Type_Info *Sema::resolve_type_inst(Ast_Type_Instantiation *type_inst) {
         return type_inst->type_value;
     }
 
+    if (type_inst->vector_element_type) {
+        auto element = resolve_type_inst(type_inst->vector_element_type);
+        if (compiler->errors_reported) return nullptr;
+
+        if (!is_int_type(element) && !is_float_type(element)) {
+            compiler->report_error(type_inst->vector_element_type, "Vector element type must be an integer or floating-point type.\n");
+            return nullptr;
+        }
+
+        auto width_expr = type_inst->vector_width_expression;
+
+        typecheck_expression(width_expr);
+        if (compiler->errors_reported) return nullptr;
+
+        if (get_type_info(width_expr)->type != Ast_Type_Info::INTEGER) {
+            compiler->report_error(width_expr, "Vector width must be an integer.\n");
+            return nullptr;
+        }
+
+        auto lit = folds_to_literal(width_expr);
+
+        if (!lit) {
+            compiler->report_error(width_expr, "Vector width must resolve to a literal expression.\n");
+            return nullptr;
+        }
+
+        if (lit->integer_value < 1 || lit->integer_value > 64) {
+            compiler->report_error(width_expr, "Vector width must be between 1 and 64, got %lld.\n", lit->integer_value);
+            return nullptr;
+        }
+
+        auto vector_type = compiler->make_vector_type(get_underlying_final_type(element), lit->integer_value);
+        type_inst->type_value = vector_type;
+        return type_inst->type_value;
+    }
+
     if (type_inst->function_header) {
         typecheck_function_header(type_inst->function_header, /*is_for_type_instantiation*/true);
         if (compiler->errors_reported) return nullptr;
@@ -4021,7 +4287,7 @@ void Sema::typecheck_function_header(Ast_Function *function, bool is_for_type_in
         if (function->is_c_function) {
             function->linkage_name = function->identifier->name->name;
         } else {
-            if (!function->scope && !function->is_intrinsic) {
+            if (!function->scope && function->intrinsic_kind == INTRINSIC_NONE) {
                 compiler->report_error(function, "Function header found without a body. Did you mean to mark this @c_function?\n");
                 return;
             }
@@ -4054,7 +4320,7 @@ void Sema::typecheck_function(Ast_Function *function) {
         }
 
         if (function->scope) {
-            assert(!function->is_intrinsic);
+            assert(function->intrinsic_kind == INTRINSIC_NONE);
             typecheck_scope(function->scope);
         }
 
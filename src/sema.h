@@ -42,6 +42,8 @@ struct Sema {
 
     void typecheck_scope(Ast_Scope *scope);
     Tuple<u64, Ast_Expression *> typecheck_and_implicit_cast_single_expression(Ast_Expression *expression, Ast_Type_Info *target_type_info, u32 allow_flags);
+    void typecheck_vector_builtin_call(Ast_Function_Call *call, Atom *name);
+    Ast_Expression *splat_scalar_to_vector(Ast_Expression *scalar, Ast_Type_Info *vector_type);
     Tuple<u64, u64> typecheck_and_implicit_cast_expression_pair(Ast_Expression *left, Ast_Expression *right, Ast_Expression **result_left, Ast_Expression **result_right, bool allow_coerce_to_ptr_void);
     void typecheck_expression(Ast_Expression *expression, Ast_Type_Info *want_numeric_type = nullptr, bool overload_set_allowed = false, bool do_function_body = false, bool only_want_struct_type = true);
 